@@ -1,6 +1,7 @@
 #pragma once
-#include "utils/json_log.hpp"
+#include "fbuf.hpp"
 #include <fstream>
+#include <future>
 
 namespace qy {
 
@@ -8,11 +9,11 @@ namespace qy {
 /// @tparam T Value type
 /// @tparam buffer_size Size of buffer elements.
 template <class T>
-class arraybuf : public json_log {
+class basic_arraybuf : public json_log {
 	constexpr static size_t value_size = sizeof(T); // Size of value type
 
 public:
-	arraybuf(size_t buffer_size, bool backward = false) :
+	basic_arraybuf(size_t buffer_size, bool backward = false) :
 		buffer_size(buffer_size), m_buf(buffer_size), m_backward(backward) {}
 
 	/// @brief Bind a file stream object.
@@ -50,7 +51,7 @@ public:
 	/// @brief Output value to buffer, and dumps if full
 	/// @param x Value
 	/// @return Self
-	inline arraybuf& operator<<(const T& x) {
+	inline basic_arraybuf& operator<<(const T& x) {
 		m_buf[m_size++] = x;
 		if (m_size == buffer_size) {
 			dump();
@@ -72,6 +73,17 @@ public:
 #endif
 	}
 
+	/// @brief Mark the block to be loaded by the next `fetch`. It loads nothing by itself.
+	/// @param pos Start pos
+	/// @param input_size Size of input elements
+	inline void prefetch(std::streampos pos, std::streamsize input_size) {
+		m_next_pos = pos;
+		m_next_size = input_size;
+	}
+
+	/// @brief Load the block marked by `prefetch`.
+	inline void fetch() { load(m_next_pos, m_next_size); }
+
 	/// @brief Dump buffer data to file
 	inline void dump() {
 		size_t wtsize = m_size * value_size;
@@ -82,7 +94,7 @@ public:
 		} else {
 			m_stream->write(reinterpret_cast<const char*>(m_buf.data()), wtsize);
 		}
-		// m_stream->flush();
+		m_stream->flush(); // Make it visible to other streams of the same file.
 		m_size = 0;
 #ifdef LOGGING
 		jinc("out");
@@ -103,10 +115,189 @@ public:
 
 private:
 	size_t buffer_size;
-	std::fstream* m_stream; // File stream
-	std::vector<T> m_buf;	// Buffer array
-	size_t m_size;			// Filled size
+	std::fstream* m_stream;		 // File stream
+	std::vector<T> m_buf;		 // Buffer array
+	size_t m_size;				 // Filled size
 	bool m_backward;
+	std::streampos m_next_pos;	 // Start pos of the prefetched block
+	std::streamsize m_next_size; // Size of the prefetched block
 };
 
-} // namespace qy
\ No newline at end of file
+/// @brief Async file buffer with double buffer.
+/// As input, `prefetch` loads the next block in background, and `fetch` waits for it and swaps buffers.
+/// As output, a full buffer is swapped out and written in background, while filling the other.
+/// An object should be used either for input or for output at a time, and the bound stream should not be shared.
+/// @tparam T Value type
+template <class T>
+class async_arraybuf : public json_log {
+	constexpr static size_t value_size = sizeof(T); // Size of value type
+
+public:
+	async_arraybuf(size_t buffer_size, bool backward = false) :
+		buffer_size(buffer_size), m_buf(buffer_size), m_buf2(buffer_size), m_backward(backward) {}
+
+	async_arraybuf(const async_arraybuf& o) : async_arraybuf(o.buffer_size, o.m_backward) {}
+
+	~async_arraybuf() { wait(); }
+
+	/// @brief Bind a file stream object.
+	/// @param stream A file stream object.
+	inline void bind(std::fstream* stream) {
+		wait();
+		m_stream = stream;
+		m_size = 0;
+#ifdef LOGGING
+		m_log["in"] = 0;
+		m_log["out"] = 0;
+#endif
+	}
+
+	/// @brief Changing the current write position. Later blocks are written from here.
+	/// @param pos A file position object.
+	inline void seekp(std::streampos pos) {
+		if (m_ofut.valid())
+			m_ofut.get();
+		m_wpos = pos;
+	}
+
+	/// @brief Get item
+	/// @param index
+	/// @return
+	inline const T operator[](size_t index) const { return m_buf[index]; }
+
+	/// @brief Output value to buffer, and dumps in background if full
+	/// @param x Value
+	/// @return Self
+	inline async_arraybuf& operator<<(const T& x) {
+		m_buf[m_size++] = x;
+		if (m_size == buffer_size) {
+			adump();
+		}
+		return *this;
+	}
+
+	/// @brief Load data to buffer synchronously
+	/// @param pos Start pos
+	/// @param input_size Size of input elements
+	inline void load(std::streampos pos, std::streamsize input_size) {
+		if (m_ifut.valid())
+			m_ifut.get();
+		read(m_buf, pos, input_size);
+		m_size = input_size;
+#ifdef LOGGING
+		jinc("in");
+#endif
+	}
+
+	/// @brief Load data to background buffer asynchronously.
+	/// @param pos Start pos
+	/// @param input_size Size of input elements
+	inline void prefetch(std::streampos pos, std::streamsize input_size) {
+		if (m_ifut.valid())
+			m_ifut.get();
+		m_ifut = std::async(std::launch::async,
+							[this, pos, input_size]() { read(m_buf2, pos, input_size); });
+		m_next_size = input_size;
+#ifdef LOGGING
+		jinc("in");
+#endif
+	}
+
+	/// @brief Wait for the prefetched block, and make it the current buffer.
+	inline void fetch() {
+		m_ifut.get();
+		std::swap(m_buf, m_buf2);
+		m_size = m_next_size;
+	}
+
+	/// @brief Dump buffer data to file, and wait until all writes complete.
+	inline void dump() {
+		if (m_ofut.valid())
+			m_ofut.get();
+		write(m_buf, m_size);
+		m_size = 0;
+#ifdef LOGGING
+		jinc("out");
+#endif
+	}
+
+	inline const T* begin() const { return m_buf.data(); }
+
+	inline const T* end() const { return m_buf.data() + m_size; }
+
+	/// @brief Get buffer size
+	/// @return Buffer size
+	inline size_t size() const { return m_size; }
+
+	/// @brief Get the bound filestream
+	/// @return fstream
+	inline const std::fstream* stream() const { return m_stream; }
+
+private:
+	/// @brief Wait for all background I/O.
+	inline void wait() {
+		if (m_ifut.valid())
+			m_ifut.get();
+		if (m_ofut.valid())
+			m_ofut.get();
+	}
+
+	/// @brief Read a block at a specific position.
+	inline void read(std::vector<T>& buf, std::streampos pos, std::streamsize input_size) {
+		m_stream->seekg(pos * value_size, m_stream->beg);
+		m_stream->read(reinterpret_cast<char*>(buf.data()), input_size * value_size);
+	}
+
+	/// @brief Write a block at the write position, and move the position forward or backward.
+	inline void write(const std::vector<T>& buf, size_t size) {
+		if (m_backward)
+			m_wpos -= size;
+		m_stream->seekp(m_wpos * value_size, m_stream->beg);
+		m_stream->write(reinterpret_cast<const char*>(buf.data()), size * value_size);
+		m_stream->flush(); // Make it visible to other streams of the same file.
+		if (!m_backward)
+			m_wpos += size;
+	}
+
+	/// @brief Swap the full buffer out and write it in background.
+	inline void adump() {
+		if (m_ofut.valid())
+			m_ofut.get();
+		std::swap(m_buf, m_buf2);
+		m_ofut = std::async(std::launch::async, [this, size = m_size]() { write(m_buf2, size); });
+		m_size = 0;
+#ifdef LOGGING
+		jinc("out");
+#endif
+	}
+
+private:
+	size_t buffer_size;
+	std::fstream* m_stream;		 // File stream
+	std::vector<T> m_buf;		 // Buffer array
+	std::vector<T> m_buf2;		 // Background buffer array
+	size_t m_size;				 // Filled size
+	bool m_backward;			 // Whether output is written backward
+	std::streamoff m_wpos;		 // Write pos, in elements
+	std::streamsize m_next_size; // Size of the prefetched block
+	std::future<void> m_ifut;	 // Future for background reading
+	std::future<void> m_ofut;	 // Future for background writing
+};
+
+template <class T, class Tag>
+struct __arraybuf_dispatcher {};
+
+template <class T>
+struct __arraybuf_dispatcher<T, basic_buffer_tag> {
+	using type = basic_arraybuf<T>;
+};
+
+template <class T>
+struct __arraybuf_dispatcher<T, double_buffer_tag> {
+	using type = async_arraybuf<T>;
+};
+
+template <class T, class Tag = basic_buffer_tag>
+using arraybuf = __arraybuf_dispatcher<T, Tag>::type;
+
+} // namespace qy
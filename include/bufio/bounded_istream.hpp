@@ -0,0 +1,52 @@
+#pragma once
+#include <algorithm>
+#include <istream>
+#include <streambuf>
+
+namespace qy {
+
+/// @brief Input stream over the next bytes of another stream, ending after a given number of them,
+/// so that a part of a file can be read as a whole stream without copying it.
+class bounded_istream : public std::istream {
+	/// @brief Stream buffer forwarding reads to the source buffer, up to the remaining bytes.
+	class bounded_streambuf : public std::streambuf {
+	public:
+		bounded_streambuf(std::streambuf* source, std::streamsize size) :
+			source(source), remaining(size) {}
+
+	protected:
+		std::streamsize xsgetn(char* s, std::streamsize n) override {
+			n = source->sgetn(s, std::min(n, remaining));
+			remaining -= n;
+			return n;
+		}
+
+		int_type underflow() override {
+			return remaining > 0 ? source->sgetc() : traits_type::eof();
+		}
+
+		int_type uflow() override {
+			if (remaining == 0)
+				return traits_type::eof();
+			remaining--;
+			return source->sbumpc();
+		}
+
+	private:
+		std::streambuf* source;
+		std::streamsize remaining;
+	};
+
+public:
+	/// @param source Source stream, read from its current position.
+	/// @param size Number of bytes to read.
+	bounded_istream(std::istream& source, std::streamsize size) :
+		std::istream(nullptr), buf(source.rdbuf(), size) {
+		rdbuf(&buf);
+	}
+
+private:
+	bounded_streambuf buf;
+};
+
+} // namespace qy
@@ -9,7 +9,8 @@ class ifbufstream_sentinel {};
 
 /// @brief Iterator for ifbufstream
 /// @tparam T Value type
-template <class T>
+/// @tparam Stream Stream type, or any other with `operator bool` and `operator>>`.
+template <class T, class Stream = base_ifbufstream<T>>
 class ifbufstream_iterator {
 public:
 	using iterator_category = std::input_iterator_tag;
@@ -18,8 +19,8 @@ public:
 	using pointer = const value_type*;
 	using reference = const value_type&;
 
-	using stream_type = base_ifbufstream<T>;
-	using self = ifbufstream_iterator<T>;
+	using stream_type = Stream;
+	using self = ifbufstream_iterator<T, Stream>;
 
 	ifbufstream_iterator() : stream(nullptr), end_marker(false) {}
 
@@ -56,6 +57,9 @@ private:
 	}
 };
 
+template <class T>
+ifbufstream_iterator(base_ifbufstream<T>&) -> ifbufstream_iterator<T>;
+
 /// @brief Iterator for ofbufstream
 /// @tparam T Value type
 template <class T>
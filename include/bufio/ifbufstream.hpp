@@ -1,5 +1,6 @@
 #pragma once
 #include "fbuf.hpp"
+#include <algorithm>
 #include <future>
 
 namespace qy {
@@ -11,7 +12,7 @@ class base_ifbufstream : public fbuf<T> {
 public:
 	using value_type = T;
 	using base = fbuf<T>;
-	using base::buffer_type;
+	using buffer_type = base::buffer_type;
 
 	base_ifbufstream(size_t buffer_size) : base(buffer_size) { clear_log(); }
 
@@ -46,6 +47,11 @@ public:
 		m_stream.close();
 	}
 
+	/// @brief Set whether the file span is read backward, from its last element to the first.
+	/// It takes effect on the next seek.
+	/// @param backward Whether to read backward.
+	void set_backward(bool backward) { m_backward = backward; }
+
 	/// @brief Changing the current read position, and set pos of EOF. It won't reload the block immediately.
 	/// @param first A file offset object.
 	/// @param last Offset as end of file.
@@ -57,6 +63,7 @@ public:
 		} else {
 			m_last = last;
 		}
+		m_rpos = m_last;
 		if (this->m_spos != first) {
 			this->m_first = this->m_spos = first;
 			m_stream.seekg(this->m_spos * this->value_size, std::ios_base::beg);
@@ -74,7 +81,11 @@ public:
 	}
 
 	/// @brief Get whether file span is end.
-	inline bool eof() { return m_stream.eof() || tellg() >= m_last; }
+	inline bool eof() {
+		if (m_backward)
+			return m_rpos <= this->m_first;
+		return m_stream.eof() || tellg() >= m_last;
+	}
 
 	/// @brief Get size of file span.
 	/// @return Span size.
@@ -102,18 +113,37 @@ public:
 protected:
 	/// @brief Load data from file to buffer.
 	inline virtual void load() {
-		m_stream.read(reinterpret_cast<char*>(this->m_buf.data()),
-					  this->m_buf.size() * this->value_size);
+		read_block(this->m_buf);
 		this->m_pos = 0;
 #ifdef LOGGING
 		this->jinc("in");
 #endif
 	}
 
+	/// @brief Read the next block into a buffer.
+	/// When reading backward, the block before the read position is read and reversed, so that
+	/// elements are still consumed from the buffer front.
+	/// @param buf The buffer.
+	inline void read_block(buffer_type& buf) {
+		if (!m_backward) {
+			m_stream.read(reinterpret_cast<char*>(buf.data()), buf.size() * this->value_size);
+			return;
+		}
+		auto k = std::min<std::streamoff>(buf.size(), m_rpos - this->m_first);
+		m_rpos -= k;
+		m_stream.seekg(m_rpos * this->value_size, std::ios_base::beg);
+		m_stream.read(reinterpret_cast<char*>(buf.data()), k * this->value_size);
+		std::reverse(buf.begin(), buf.begin() + k);
+	}
+
 	/// @brief The input file stream.
 	std::ifstream m_stream;
 	/// @brief Last element pos of file span.
 	std::streamoff m_last;
+	/// @brief Whether the file span is read backward.
+	bool m_backward = false;
+	/// @brief First element pos of data read, when reading backward.
+	std::streamoff m_rpos;
 };
 
 /// @brief Basic ifstream with buffer.
@@ -181,10 +211,7 @@ public:
 private:
 	/// @brief Load data to background buffer.
 	inline void aload() {
-		m_bufuture = std::async(std::launch::async, [this]() {
-			this->m_stream.read(reinterpret_cast<char*>(this->m_buf2.data()),
-								this->m_buf2.size() * this->value_size);
-		});
+		m_bufuture = std::async(std::launch::async, [this]() { this->read_block(m_buf2); });
 #ifdef LOGGING
 		this->jinc("in");
 #endif
@@ -203,6 +230,100 @@ private:
 	std::future<void> m_bufuture;
 };
 
+/// @brief Input stream with double buffer over any `std::istream`, such as stdin or a pipe.
+/// The length is unknown until the source ends, so it only reads forward, and knows the end once a
+/// block comes short. A trailing partial value is dropped.
+/// @tparam T Value type.
+template <class T>
+class istream_ifbufstream : public json_log {
+public:
+	using value_type = T;
+	constexpr static size_t value_size = sizeof(value_type);
+
+	/// @brief Load the first block synchronously, and the next one asynchronously.
+	istream_ifbufstream(size_t buffer_size, std::istream& stream) :
+		m_stream(&stream), m_buf(buffer_size), m_buf2(buffer_size) {
+#ifdef LOGGING
+		this->m_log["in"] = 1;
+#endif
+		m_size = read_block(m_buf);
+		if (m_size == m_buf.size())
+			aload();
+	}
+
+	istream_ifbufstream(const istream_ifbufstream&) = delete;
+
+	~istream_ifbufstream() { close(); }
+
+	/// @brief Wait for the pending load. The source stream is left open.
+	void close() {
+		if (m_bufuture.valid())
+			m_bufuture.get();
+	}
+
+	/// @brief Whether any value remains. It may wait for the next block to know.
+	inline operator bool() {
+		if (m_pos == m_size)
+			swap_buffer();
+		return m_pos < m_size;
+	}
+
+	inline istream_ifbufstream& operator>>(value_type& x) {
+		if (m_pos == m_size)
+			swap_buffer();
+		x = m_buf[m_pos++];
+		return *this;
+	}
+
+	/// @brief Read one element.
+	/// @return Element value.
+	inline value_type get() {
+		value_type x;
+		*this >> x;
+		return x;
+	}
+
+private:
+	/// @brief Read a block from the stream.
+	/// @return Number of elements read.
+	size_t read_block(std::vector<value_type>& buf) {
+		m_stream->read(reinterpret_cast<char*>(buf.data()), buf.size() * value_size);
+		return m_stream->gcount() / value_size;
+	}
+
+	/// @brief Load data to background buffer.
+	inline void aload() {
+		m_bufuture = std::async(std::launch::async, [this]() { return read_block(m_buf2); });
+#ifdef LOGGING
+		this->jinc("in");
+#endif
+	}
+
+	/// @brief Swap two buffers, and load the next block unless the stream has ended.
+	inline void swap_buffer() {
+		if (!m_bufuture.valid())
+			return; // A short block was the last one.
+		m_size = m_bufuture.get();
+		std::swap(m_buf, m_buf2);
+		m_pos = 0;
+		if (m_size == m_buf.size())
+			aload();
+	}
+
+	/// @brief The source stream.
+	std::istream* m_stream;
+	/// @brief Current pos of buffer.
+	size_t m_pos = 0;
+	/// @brief Number of elements in buffer.
+	size_t m_size = 0;
+	/// @brief Buffer array.
+	std::vector<value_type> m_buf;
+	/// @brief Background buffer.
+	std::vector<value_type> m_buf2;
+	/// @brief Future for background reading, giving the number of elements read.
+	std::future<size_t> m_bufuture;
+};
+
 template <class T, class Tag>
 struct __ifbufstream_dispatcher {};
 
@@ -1,6 +1,9 @@
 #pragma once
 #include "fbuf.hpp"
+#include "ifbufstream.hpp"
+#include "ofbufstream.hpp"
 #include <atomic>
+#include <functional>
 #include <future>
 
 namespace qy {
@@ -32,6 +35,11 @@ public:
 		open(input_path, output_path);
 	}
 
+	async_iofbufstream(size_t buffer_size, std::istream& input, const fs::path& output_path) :
+		async_iofbufstream(buffer_size) {
+		open(input, output_path);
+	}
+
 	~async_iofbufstream() { close(); }
 
 #ifdef LOGGING
@@ -45,25 +53,40 @@ public:
 	/// @param input_path Path of input file.
 	/// @param output_path Path of output file.
 	void open(const fs::path& input_path, const fs::path& output_path) {
-		m_istream.open(input_path, std::ios_base::binary);
+		m_ifstream.open(input_path, std::ios_base::binary);
+		open(m_ifstream, output_path);
+	}
+
+	/// @brief Opens an input stream of unknown length, such as stdin or a pipe, and output file.
+	/// @param input Input stream, read until its end.
+	/// @param output_path Path of output file.
+	void open(std::istream& input, const fs::path& output_path) {
+		m_istream = &input;
 		m_ostream.open(output_path, std::ios_base::binary);
 		m_ispos = m_isize = 0;
 		load();
-		if (!m_istream.eof())
+		if (!m_istream->eof())
 			aload();
 	}
 
 	/// @brief Close the stream.
 	void close() {
+		if (m_ifut.valid())
+			m_ifut.wait();
 		if (m_ofut.valid())
 			m_ofut.get();
 		dump();
-		m_istream.close();
+		m_ifstream.close();
 		m_ostream.close();
 	}
 
 	/// @brief Check whether encounters end of input file.
-	bool ieof() const { return m_ieof && m_ispos == m_isize; }
+	/// If all loaded data is consumed, it awaits the pending load, which may be the one to hit EOF.
+	bool ieof() {
+		if (m_ispos == m_isize && !m_ieof && m_ifut.valid())
+			m_ifut.wait();
+		return m_ieof && m_ispos == m_isize;
+	}
 
 	inline self& operator>>(value_type& x) {
 		if (m_ipos == buffer_size) {
@@ -87,10 +110,10 @@ public:
 private:
 	/// @brief Load data from file to buffer.
 	inline virtual void load() {
-		m_istream.read(reinterpret_cast<char*>(m_buf.data()), m_buf.size() * value_size);
+		m_istream->read(reinterpret_cast<char*>(m_buf.data()), m_buf.size() * value_size);
 		m_ipos = 0;
-		m_isize += m_istream.gcount() / value_size;
-		m_ieof = m_istream.eof();
+		m_isize += m_istream->gcount() / value_size;
+		m_ieof = m_istream->eof();
 #ifdef LOGGING
 		jinc("in");
 #endif
@@ -99,10 +122,10 @@ private:
 	/// @brief Load data to background buffer.
 	inline void aload() {
 		m_ifut = std::async(std::launch::async, [this]() {
-			this->m_istream.read(reinterpret_cast<char*>(this->m_ibuf.data()),
-								 this->m_ibuf.size() * this->value_size);
-			this->m_isize += this->m_istream.gcount() / value_size;
-			this->m_ieof = this->m_istream.eof();
+			this->m_istream->read(reinterpret_cast<char*>(this->m_ibuf.data()),
+								  this->m_ibuf.size() * this->value_size);
+			this->m_isize += this->m_istream->gcount() / value_size;
+			this->m_ieof = this->m_istream->eof();
 		});
 #ifdef LOGGING
 		jinc("in");
@@ -155,8 +178,10 @@ private:
 	std::streamoff m_ispos;
 	/// @brief Current size of input file.
 	std::atomic<std::streamsize> m_isize;
-	/// @brief The istream.
-	std::ifstream m_istream;
+	/// @brief The input file, if opened by path.
+	std::ifstream m_ifstream;
+	/// @brief The istream, the input file or any other stream.
+	std::istream* m_istream = nullptr;
 	/// @brief The ostream.
 	std::ofstream m_ostream;
 	/// @brief Main buffer array.
@@ -173,4 +198,59 @@ private:
 	std::atomic<bool> m_ieof;
 };
 
+/// @brief An fstream with separate buffers for input and output.
+/// It has the same interface as `async_iofbufstream`, but output may lag behind input by any
+/// amount, at the cost of two more buffers. Input values may be of another type, lifted to values
+/// as they are read.
+/// @tparam T Value type.
+/// @tparam In Input value type.
+/// @tparam Lift Function object lifting an input value to a value.
+template <class T, class In = T, class Lift = std::identity>
+class split_iofbufstream : public json_log {
+public:
+	using value_type = T;
+	using input_type = In;
+	using self = split_iofbufstream<T, In, Lift>;
+
+	split_iofbufstream(size_t buffer_size, const fs::path& input_path, const fs::path& output_path) :
+		m_ifstream(input_path, std::ios_base::binary),
+		m_istream(buffer_size, m_ifstream),
+		m_ostream(buffer_size, output_path) {}
+
+	/// @param input Input stream of unknown length, such as stdin or a pipe.
+	split_iofbufstream(size_t buffer_size, std::istream& input, const fs::path& output_path) :
+		m_istream(buffer_size, input), m_ostream(buffer_size, output_path) {}
+
+	/// @brief Close the stream.
+	void close() {
+		m_istream.close();
+		m_ifstream.close();
+		m_ostream.close();
+#ifdef LOGGING
+		this->m_log["in"] = m_istream.get_log()["in"];
+		this->m_log["out"] = m_ostream.get_log()["out"];
+#endif
+	}
+
+	/// @brief Check whether encounters end of input file.
+	bool ieof() { return !m_istream; }
+
+	inline self& operator>>(value_type& x) {
+		x = m_lift(m_istream.get());
+		return *this;
+	}
+
+	inline self& operator<<(const value_type& x) {
+		m_ostream << x;
+		return *this;
+	}
+
+private:
+	/// @brief The input file, if opened by path.
+	std::ifstream m_ifstream;
+	istream_ifbufstream<input_type> m_istream;
+	Lift m_lift{};
+	ofbufstream<value_type, double_buffer_tag> m_ostream;
+};
+
 } // namespace qy
\ No newline at end of file
@@ -58,14 +58,38 @@ private:
 			throw std::logic_error("It should be empty!");
 		std::swap(this->m_buf, m_buf_queue.front());
 		m_buf_queue.pop_front();
+		if (m_loading && m_buf_queue.size() == 1) {
+			// The next buffer is still being loaded by the pool. Await it.
+			m_loading->get();
+			m_loading = nullptr;
+		}
 		if (m_buf_queue.empty()) {
-			throw std::logic_error(std::string("Buffer not available! "));
+			// The pool had no free buffer to load ahead. Read the next block on demand into the
+			// buffer just consumed, so that the pool keeps its size.
+			m_buf_queue.push_back(std::move(this->m_buf));
+			load_block(m_buf_queue.back());
+#ifdef LOGGING
+			this->jinc("in");
+#endif
 		}
 		this->m_pos = 0;
 	}
 
+	/// @brief Read the next block of the span into a buffer.
+	/// @param buf The buffer.
+	void load_block(buffer_type& buf) {
+		if (this->m_backward) {
+			this->read_block(buf);
+			return;
+		}
+		auto siz = std::min(this->m_last - this->m_spos, (ptrdiff_t)buf.size());
+		this->m_stream.read(reinterpret_cast<char*>(buf.data()), siz * this->value_size);
+	}
+
 	/// @brief Queue of buffers.
 	std::list<buffer_type> m_buf_queue;
+	/// @brief Pending load of the last buffer of the queue, or null if none.
+	std::future<void>* m_loading = nullptr;
 
 	friend class ifbufstream_pool<value_type>;
 };
@@ -84,6 +108,7 @@ public:
 #ifdef LOGGING
 		m_log["buffer_size"] = buffer_size;
 		m_log["app"].clear();
+		m_log["skipped"] = 0;
 #endif
 	}
 
@@ -110,6 +135,14 @@ public:
 		// Await input loading.
 		if (m_bufuture.valid())
 			m_bufuture.get();
+		for (auto&& buf : m_bufs)
+			buf.m_loading = nullptr;
+		// Reclaim buffers of exhausted streams, which are never read again.
+		for (auto&& buf : m_bufs) {
+			if (buf.m_spos == buf.m_last && !buf.m_buf_queue.empty()) {
+				m_free_bufs.splice(m_free_bufs.end(), buf.m_buf_queue);
+			}
+		}
 		// Find the buffer with least last key.
 		auto p = m_bufs.end();
 		for (auto it = m_bufs.begin(); it != m_bufs.end(); ++it) {
@@ -118,21 +151,20 @@ public:
 				p = it;
 			}
 		}
-		// If find any buffer that need supplement, load for it.
-		if (p != m_bufs.end()) {
-			// It should have free buffers.
-			if (m_free_bufs.empty()) {
-				throw std::runtime_error("No free buffers!");
-			}
+		// If find any buffer that need supplement, load for it. Without a free buffer, the load is
+		// skipped this round, and the stream reads on demand if it runs out.
+		if (p != m_bufs.end() && m_free_bufs.empty()) {
+#ifdef LOGGING
+			jinc("skipped");
+#endif
+		} else if (p != m_bufs.end()) {
 			// Get free buffer, and push it to the back of that queue.
 			p->m_buf_queue.push_back(std::move(m_free_bufs.front()));
 			m_free_bufs.pop_front();
 			// Launch async load.
-			m_bufuture = std::async(std::launch::async, [this, p]() {
-				auto&& loading_buf = p->m_buf_queue.back();
-				auto siz = std::min(p->m_last - p->m_spos, (ptrdiff_t)loading_buf.size());
-				p->m_stream.read(reinterpret_cast<char*>(loading_buf.data()), siz * p->value_size);
-			});
+			m_bufuture = std::async(std::launch::async,
+									[p]() { p->load_block(p->m_buf_queue.back()); });
+			p->m_loading = &m_bufuture;
 #ifdef LOGGING
 			m_log["app"].push_back(p - m_bufs.begin());
 #endif
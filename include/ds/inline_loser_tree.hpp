@@ -0,0 +1,122 @@
+#pragma once
+#include "./loser_tree.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace qy {
+
+/// @brief A Loser Tree keeping the loser key inline in each node.
+/// Nodes are stored in a cache-line-aligned array, so that replaying a path touches one node per
+/// level, without loading the key from a separate data array.
+/// It has the same interface as `loser_tree`.
+/// @tparam _Tp Value type. It should be trivially copyable and cheap to compare, such as a packed key.
+template <class _Tp>
+class inline_loser_tree {
+	using value_type = _Tp;
+
+	static_assert(std::is_trivially_copyable_v<value_type>, "Value type must be trivially copyable.");
+
+	/// @brief Size of cache line, in bytes.
+	constexpr static size_t cache_line_size = 64;
+
+	/// @brief A node with loser key and its index.
+	/// The index is 32-bit, so that a node of a small key fits in 8 bytes.
+	struct node {
+		value_type key;
+		uint32_t index;
+	};
+
+	struct aligned_deleter {
+		void operator()(node* p) const { ::operator delete[](p, std::align_val_t{cache_line_size}); }
+	};
+
+public:
+	/// @brief Construct empty tree by default.
+	inline_loser_tree(size_t size) :
+		m_size(size),
+		m_nodes(static_cast<node*>(
+			::operator new[](std::max(size, (size_t)1) * sizeof(node), std::align_val_t{cache_line_size}))) {
+		std::fill_n(m_nodes.get(), std::max(size, (size_t)1), node{value_type{}, 0});
+	}
+
+	/// @brief Construct a tree from values at all positions, by playing the tournament bottom-up.
+	/// Unlike pushing values one by one, it does not require the default value to be the least.
+	/// @param data Values at all positions.
+	inline_loser_tree(const std::vector<value_type>& data) : inline_loser_tree(data.size()) {
+		size_t n = m_size;
+		if (n == 0)
+			return;
+		// Winner of each node, with leaf i at node n + i.
+		std::vector<node> winner(n * 2);
+		for (size_t i = 0; i < n; i++)
+			winner[n + i] = {data[i], (uint32_t)i};
+		for (size_t i = n - 1; i > 0; i--) {
+			const node &a = winner[i * 2], &b = winner[i * 2 + 1];
+			bool c = b.key < a.key;
+			winner[i] = c ? b : a;
+			m_nodes[i] = c ? a : b;
+		}
+		m_nodes[0] = winner[1];
+	}
+
+	inline_loser_tree(inline_loser_tree&&) = default;
+
+	inline_loser_tree& operator=(inline_loser_tree&&) = default;
+
+	/// @brief Get the top element.
+	/// @return The top element.
+	const value_type& top() const { return m_nodes[0].key; }
+
+	/// @brief Get the index of the top element.
+	size_t top_index() const { return m_nodes[0].index; }
+
+	/// @brief Push new value to the tree, replacing the top element.
+	/// @param value Data value.
+	void push(const value_type& value) {
+		node winner{value, m_nodes[0].index};
+		node* nodes = m_nodes.get();
+		for (size_t i = (winner.index + m_size) >> 1; i > 0; i >>= 1) {
+			// If the upcoming winner is current loser, just swap.
+			if (nodes[i].key < winner.key)
+				std::swap(nodes[i], winner);
+		}
+		nodes[0] = winner;
+	}
+
+	/// @brief Mark the position of the top element exhausted, by pushing the sentinel.
+	void pop()
+		requires has_sentinel<value_type>
+	{
+		push(loser_tree_traits<value_type>::sentinel());
+	}
+
+	/// @brief Push new value to the tree at a specific position.
+	/// It is used to initialize the tree, so that a node holding a stale key of the same position is
+	/// refreshed, as `loser_tree` does.
+	/// @param value Data value.
+	/// @param i Position.
+	void push_at(const value_type& value, size_t i) {
+		node winner{value, (uint32_t)i};
+		for (size_t j = (i + m_size) >> 1; j > 0; j >>= 1) {
+			if (m_nodes[j].index == winner.index)
+				m_nodes[j].key = winner.key;
+			else if (m_nodes[j].key < winner.key)
+				std::swap(m_nodes[j], winner);
+		}
+		m_nodes[0] = winner;
+	}
+
+	size_t size() const { return m_size; }
+
+private:
+	/// @brief Number of leaves.
+	size_t m_size;
+	/// @brief Winner at 0 and losers at internal nodes, in heap order.
+	std::unique_ptr<node[], aligned_deleter> m_nodes;
+};
+
+} // namespace qy
@@ -1,9 +1,36 @@
 #pragma once
 #include <vector>
 #include <algorithm>
+#include <concepts>
+#include <limits>
+#include <type_traits>
 
 namespace qy {
 
+/// @brief Traits of values in loser trees.
+/// `sentinel()` gives a value not less than any other, used as +inf to fill exhausted positions.
+/// Since a real value may equal it, callers should count remaining elements to stop.
+/// @tparam T Value type.
+template <class T>
+struct loser_tree_traits {};
+
+template <class T>
+	requires std::is_arithmetic_v<T>
+struct loser_tree_traits<T> {
+	static constexpr T sentinel() {
+		if constexpr (std::numeric_limits<T>::has_infinity)
+			return std::numeric_limits<T>::infinity();
+		else
+			return std::numeric_limits<T>::max();
+	}
+};
+
+/// @brief Types with a +inf sentinel for loser trees.
+template <class T>
+concept has_sentinel = requires {
+	{ loser_tree_traits<T>::sentinel() } -> std::convertible_to<T>;
+};
+
 /// @brief A Loser Tree for external merge sort.
 /// @tparam _Tp Value type.
 /// @tparam _Nm Number of elements.
@@ -15,14 +42,44 @@ public:
 	/// @brief Construct empty tree by default.
 	loser_tree(size_t size) : m_tree(size, 0), m_data(size, value_type{}) {}
 
+	/// @brief Construct a tree from values at all positions, by playing the tournament bottom-up.
+	/// Unlike pushing values one by one, it does not require the default value to be the least.
+	/// @param data Values at all positions.
+	loser_tree(std::vector<value_type> data) : m_tree(data.size(), 0), m_data(std::move(data)) {
+		size_t n = m_data.size();
+		if (n == 0)
+			return;
+		// Winner of each node, with leaf i at node n + i.
+		std::vector<size_t> winner(n * 2);
+		for (size_t i = 0; i < n; i++)
+			winner[n + i] = i;
+		for (size_t i = n - 1; i > 0; i--) {
+			size_t a = winner[i * 2], b = winner[i * 2 + 1];
+			bool c = m_data[b] < m_data[a];
+			winner[i] = c ? b : a;
+			m_tree[i] = c ? a : b;
+		}
+		m_tree[0] = winner[1];
+	}
+
 	/// @brief Get the top element.
 	/// @return The top element.
 	const value_type& top() const { return m_data[m_tree[0]]; }
 
+	/// @brief Get the index of the top element.
+	size_t top_index() const { return m_tree[0]; }
+
 	/// @brief Push new value to the tree.
 	/// @param value Data value.
 	void push(const value_type& value) { push_at(value, m_tree[0]); }
 
+	/// @brief Mark the position of the top element exhausted, by pushing the sentinel.
+	void pop()
+		requires has_sentinel<value_type>
+	{
+		push(loser_tree_traits<value_type>::sentinel());
+	}
+
 	/// @brief Push new value to the tree at a specific position.
 	/// @param value Data value.
 	/// @param i Position.
@@ -0,0 +1,89 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <vector>
+
+namespace qy {
+
+/// @brief A branchless selector of the minimum among a small number of packed entries.
+/// Heads of all runs are kept in a small aligned array, and each selection is a tournament of
+/// fixed shape, reduced with conditional moves instead of data-dependent branches. The index of
+/// each entry is recovered from its low tag, so no argmin is needed.
+/// It has the same interface as `loser_tree`.
+/// @tparam Entry Packed entry type, see `packed_key`.
+/// @tparam MaxSize Maximal number of runs.
+template <class Entry, size_t MaxSize = 16>
+class tournament_selector {
+	using value_type = typename Entry::word_type;
+
+	static_assert(Entry::is_packed, "Entries must be packed words.");
+	static_assert(std::has_single_bit(MaxSize), "Maximal size must be a power of 2.");
+
+public:
+	constexpr static size_t max_size = MaxSize;
+
+	/// @brief Construct a selector with all positions empty.
+	tournament_selector(size_t size) : m_size(size), m_width(std::bit_ceil(size)) {
+		assert(size <= max_size);
+		// Padding entries are greater than any packed entry in use.
+		std::fill_n(m_heads, max_size, ~value_type{});
+		m_top = ~value_type{};
+	}
+
+	/// @brief Construct a selector from values at all positions.
+	/// @param data Values at all positions.
+	tournament_selector(const std::vector<value_type>& data) : tournament_selector(data.size()) {
+		std::ranges::copy(data, m_heads);
+		select();
+	}
+
+	/// @brief Get the top element.
+	/// @return The top element.
+	const value_type& top() const { return m_top; }
+
+	/// @brief Get the index of the top element.
+	size_t top_index() const { return Entry::low(m_top); }
+
+	/// @brief Push new value to the selector, replacing the top element.
+	/// @param value Data value.
+	void push(const value_type& value) { push_at(value, top_index()); }
+
+	/// @brief Push new value to the selector at a specific position.
+	/// @param value Data value.
+	/// @param i Position.
+	void push_at(const value_type& value, size_t i) {
+		m_heads[i] = value;
+		select();
+	}
+
+	size_t size() const { return m_size; }
+
+private:
+	/// @brief Find the minimum by pairwise reduction.
+	void select() {
+		if (m_width == 1) {
+			m_top = m_heads[0];
+			return;
+		}
+		alignas(64) value_type t[max_size / 2];
+		size_t s = m_width >> 1;
+		for (size_t i = 0; i < s; i++)
+			t[i] = m_heads[i + s] < m_heads[i] ? m_heads[i + s] : m_heads[i];
+		for (s >>= 1; s > 0; s >>= 1)
+			for (size_t i = 0; i < s; i++)
+				t[i] = t[i + s] < t[i] ? t[i + s] : t[i];
+		m_top = t[0];
+	}
+
+	/// @brief Number of runs.
+	size_t m_size;
+	/// @brief Number of runs, rounded up to a power of 2.
+	size_t m_width;
+	/// @brief The top element.
+	value_type m_top;
+	/// @brief Heads of runs.
+	alignas(64) value_type m_heads[max_size];
+};
+
+} // namespace qy
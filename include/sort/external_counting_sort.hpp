@@ -0,0 +1,178 @@
+#pragma once
+#include "./base_sorter.hpp"
+#include "./output_mode.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace qy {
+
+/// @brief Whether values are integers with a domain of at most 2^16 values, to sort by counting.
+template <class T>
+concept small_domain = std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= 2;
+
+/// @brief External counting sort for values of a small domain.
+/// A streaming pass counts the occurrences of each value, with a histogram per thread over a slice
+/// of the input, and the histograms are summed at the end. Then the output is written sequentially
+/// by filling the buffer with the run of each value. Thus the data is read once and written once,
+/// regardless of its size. Collapsing output modes write each value present once instead of its
+/// run, combined from its count.
+/// @tparam T Value type.
+/// @tparam Mode Output mode, see `output_mode.hpp`. Counting keys writes `counted_record<T>`.
+template <small_domain T, class Mode = keep_all>
+class external_counting_sorter : public base_sorter {
+public:
+	using value_type = T;
+	using output_type = mode_value_t<T, Mode>;
+	using count_type = uint64_t;
+	/// @brief Number of distinct values.
+	constexpr static size_t domain = (size_t)1 << (sizeof(value_type) * 8);
+
+	/// @param buffer_size Total size of buffers of all threads.
+	/// @param threads Maximal number of threads to count.
+	external_counting_sorter(size_t buffer_size,
+							 size_t threads = std::thread::hardware_concurrency()) :
+		base_sorter(buffer_size), threads(std::max(threads, (size_t)1)) {}
+
+	void operator()(const fs::path& input_path, const fs::path& output_path) {
+		sort(input_path, output_path);
+	}
+
+	/// @brief Sort values from an input stream of unknown length, such as stdin or a pipe.
+	/// The stream is counted by one thread as data arrives, without staging it on disk.
+	/// @param input Input stream, read until its end.
+	/// @param output_path Path of output file.
+	void operator()(std::istream& input, const fs::path& output_path) { sort(input, output_path); }
+
+private:
+	/// @brief Count the input, then write the output.
+	/// @param input Path of input file, or an input stream.
+	template <class Input>
+	void sort(Input&& input, const fs::path& output_path) {
+		auto start = std::chrono::steady_clock::now();
+		auto hist = count(input);
+		auto mid = std::chrono::steady_clock::now();
+		write(hist, output_path);
+#ifdef LOGGING
+		auto end = std::chrono::steady_clock::now();
+		m_log["distinct"] = std::ranges::count_if(hist, [](count_type c) { return c > 0; });
+		m_log["count_time"] = std::chrono::duration<double>(mid - start).count();
+		m_log["write_time"] = std::chrono::duration<double>(end - mid).count();
+#endif
+	}
+
+	/// @brief Index of a value in the histogram.
+	static size_t index(value_type x) {
+		return (size_t)((int64_t)x - std::numeric_limits<value_type>::min());
+	}
+
+	/// @brief Value at an index of the histogram.
+	static value_type value(size_t i) {
+		return (value_type)((int64_t)i + std::numeric_limits<value_type>::min());
+	}
+
+	/// @brief Count occurrences of all values in parallel.
+	/// The input is split into contiguous slices, each read by a thread with its own stream.
+	std::vector<count_type> count(const fs::path& input_path) {
+		size_t n = fs::file_size(input_path) / sizeof(value_type);
+		// No more threads than buffers of input, so that each thread reads large blocks.
+		size_t k = std::clamp(n / std::max(buffer_size, (size_t)1), (size_t)1, threads);
+		size_t slice = (n + k - 1) / k;
+		size_t block = std::max(buffer_size / k, (size_t)1);
+		std::vector<std::future<std::vector<count_type>>> futures;
+		for (size_t t = 0; t < k; t++) {
+			futures.push_back(std::async(std::launch::async, [&, t]() {
+				std::vector<count_type> h(domain);
+				std::vector<value_type> buf(block);
+				size_t first = std::min(n, t * slice), last = std::min(n, first + slice);
+				std::ifstream fin(input_path, std::ios_base::binary);
+				fin.seekg(first * sizeof(value_type), std::ios_base::beg);
+				for (size_t i = first; i < last;) {
+					size_t m = std::min(block, last - i);
+					fin.read(reinterpret_cast<char*>(buf.data()), m * sizeof(value_type));
+					for (size_t j = 0; j < m; j++)
+						h[index(buf[j])]++;
+					i += m;
+				}
+				return h;
+			}));
+		}
+		// Sum histograms of all threads.
+		std::vector<count_type> hist(domain);
+		for (auto&& f : futures) {
+			auto h = f.get();
+			for (size_t i = 0; i < domain; i++)
+				hist[i] += h[i];
+		}
+#ifdef LOGGING
+		m_log["threads"] = k;
+#endif
+		return hist;
+	}
+
+	/// @brief Count occurrences of all values of a stream, block by block.
+	std::vector<count_type> count(std::istream& input) {
+		std::vector<count_type> hist(domain);
+		istream_ifbufstream<value_type> input_buf(std::max(buffer_size, (size_t)1), input);
+		while (input_buf)
+			hist[index(input_buf.get())]++;
+#ifdef LOGGING
+		m_log["threads"] = 1;
+#endif
+		return hist;
+	}
+
+	/// @brief Write runs of all values in order, filling the buffer by runs, or each value present
+	/// once if the output mode collapses them.
+	void write(const std::vector<count_type>& hist, const fs::path& output_path) {
+		std::ofstream fout(output_path, std::ios_base::binary | std::ios_base::trunc);
+		std::vector<output_type> buf(std::max(buffer_size, (size_t)1));
+		size_t pos = 0;
+		auto flush = [&]() {
+			fout.write(reinterpret_cast<const char*>(buf.data()), pos * sizeof(output_type));
+			pos = 0;
+		};
+		for (size_t i = 0; i < domain; i++) {
+			if constexpr (!collapses<Mode>) {
+				for (count_type c = hist[i]; c > 0;) {
+					size_t m = std::min((size_t)c, buf.size() - pos);
+					std::fill_n(buf.begin() + pos, m, value(i));
+					pos += m;
+					c -= m;
+					if (pos == buf.size())
+						flush();
+				}
+			} else if (hist[i] > 0) {
+				buf[pos++] = reduce(value(i), hist[i]);
+				if (pos == buf.size())
+					flush();
+			}
+		}
+		flush();
+	}
+
+	/// @brief Combine `c` occurrences of a value by the output mode.
+	output_type reduce(value_type x, count_type c) const {
+		if constexpr (std::is_same_v<Mode, count_keys>)
+			return {{x, c}};
+		else {
+			output_type acc = x;
+			if constexpr (!std::is_same_v<Mode, keep_unique>) {
+				for (count_type j = 1; j < c; j++)
+					mode(acc, x);
+			}
+			return acc;
+		}
+	}
+
+	/// @brief Maximal number of threads to count.
+	size_t threads;
+	/// @brief Output mode.
+	Mode mode{};
+};
+
+} // namespace qy
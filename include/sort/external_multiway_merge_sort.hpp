@@ -1,128 +1,324 @@
 #pragma once
 #include "./base_sorter.hpp"
-#include "./replacement_selection.hpp"
+#include "./merge_planner.hpp"
+#include "./merge_stream.hpp"
+#include "./merge_word.hpp"
+#include "./output_mode.hpp"
+#include "./run_generator.hpp"
+#include "./two_level_merger.hpp"
 #include "bufio/pooled_ifbufsteam.hpp"
+#include "ds/inline_loser_tree.hpp"
+#include "ds/tournament_selector.hpp"
+#include <optional>
+#include <span>
 
 namespace qy {
 
 /// @brief External multi-way merge sort implementation.
 /// @tparam T Value type.
-template <class T>
+/// @tparam Mode Output mode, collapsing equal values in run generation and every merge pass, see
+/// `output_mode.hpp`. Counting keys of plain
+/// values sorts `counted_record<T>`, lifted from the input as runs are formed.
+template <class T, class Mode = keep_all>
 class external_multiway_merge_sorter : public base_sorter {
 public:
-	using value_type = T;
+	using value_type = mode_value_t<T, Mode>;
+	using input_type = T;
+	/// @brief Loser tree word, packing the run index.
+	/// The buffer pool forecasts the run exhausted first by last keys, so the merge should break
+	/// ties by run index as well. Without the pool, bare values are held if they have a sentinel.
+	using word = merge_word<value_type, false>;
+	/// @brief Loser tree type. Packed entries are kept inline in tree nodes.
+	using tree_type =
+		std::conditional_t<word::entry::is_packed, inline_loser_tree<typename word::word_type>,
+						   loser_tree<typename word::word_type>>;
+	/// @brief Range of merge orders to select by branchless tournament instead of loser tree.
+	/// By bench_loser_tree on 2^22 values, the tournament beats the inline loser tree on 64-bit
+	/// words only from k = 4 to 16 (i32: 18.8 vs 24.5 ns at k = 4, 30.7 vs 40.3 ns at k = 16), and
+	/// loses at every order on 128-bit words (f64: 27.9 vs 20.8 ns at k = 2, 32.5 vs 24.7 ns at
+	/// k = 4), so it is not used for them.
+	constexpr static size_t min_small_order = 4;
+	constexpr static size_t small_order =
+		word::entry::is_packed && sizeof(typename word::word_type) <= 8 ? 16 : 0;
+	/// @brief Minimal merge order to merge by two-level merger instead of a single loser tree.
+	/// By bench_loser_tree, it beats the inline loser tree from k = 256 (i32: 79.6 vs 87.3 ns, f64:
+	/// 88.3 vs 95.6 ns), but not at k = 64, and it stays under the default limit of open files.
+	constexpr static size_t large_order = 256;
+
+	/// @brief Minimal buffer size of a run in bytes. Fan-in is bounded, so that a run is not read in
+	/// blocks smaller than a page.
+	constexpr static size_t min_block_bytes = 4096;
 
 	using base_sorter::base_sorter;
 
 	void operator()(const fs::path& input_path, const fs::path& output_path) {
+		sort(input_path, output_path);
+	}
+
+	void operator()(const fs::path& input_path, const fs::path& output_path, int x) {
 		auto tmp_path = output_path;
 		tmp_path.replace_filename(".merge");
-
-		replacement_selection<value_type> repsel(buffer_size);
-		segments = repsel(input_path, tmp_path); // Call replacement selection
-#ifdef LOGGING
-		m_log["repsel"] = repsel.get_log();
-#endif
+		segments.clear();
+		replacement_selection<value_type, Mode, input_type> repsel(buffer_size);
+		for (size_t s : repsel(input_path, tmp_path))
+			segments.push_back({s, false}); // Call replacement selection
 
 		/// Now merge.
 
-		size_t merge_order = segments.size(); // Merge order
-		size_t buffer_size_2 = std::max(buffer_size * 2 / merge_order,
-										(size_t)16); // Add 1 for fear of zero trap.
-		//printf("order = %d, size = %d\n", merge_order, buffer_size_2);
-		ifbufstream_pool<value_type> pool(merge_order, buffer_size_2); // Buffer pool
-		ofbufstream<value_type, double_buffer_tag> output_buf(buffer_size_2,
+		using ifbufstream_t = ifbufstream<value_type, double_buffer_tag>;
+		size_t merge_order = segments.size();						   // Merge order
+		std::vector<ifbufstream_t> inputs(merge_order, {buffer_size}); // Input buffers.
+		ofbufstream<value_type, double_buffer_tag> output_buf(buffer_size,
 															  output_path); // Output buffer
 		// Init input buffers.
 		for (size_t sum = 0, i = 0; i < merge_order; i++) {
-			pool[i].open(tmp_path);
-			pool[i].seek(sum, sum + segments[i]);
-			sum += segments[i];
+			inputs[i].open(tmp_path);
+			inputs[i].seek(sum, sum + segments[i].size);
+			sum += segments[i].size;
 		}
-		pool.collect_allocate(); // Maybe this is important
 
-		// Loser tree. The 0-th of each element marks whether it is virtual.
-		loser_tree<std::tuple<int, value_type, int>> lt(merge_order);
-		// Initialize loser tree
-		for (ssize_t i = merge_order - 1; i >= 0; i--) {
-			lt.push_at({1, pool[i].get(), i}, i);
+		using bare_word = merge_word<value_type>;
+		reducing_writer<value_type, Mode, ofbufstream<value_type, double_buffer_tag>> out(output_buf);
+		merge<loser_tree<typename bare_word::word_type>, bare_word>(
+			inputs, merge_order, out, fs::file_size(tmp_path) / sizeof(value_type));
+		out.flush();
+		for (auto&& input : inputs)
+			input.close();
+		fs::remove(tmp_path);
+	}
+
+	/// @brief Sort values from an input stream of unknown length, such as stdin or a pipe.
+	/// Runs are generated as data arrives, so the input needs not be staged on disk first.
+	/// @param input Input stream, read until its end.
+	/// @param output_path Path of output file.
+	void operator()(std::istream& input, const fs::path& output_path) { sort(input, output_path); }
+
+	/// @brief Sort the input by all merge passes but the last, and return the last one as a stream
+	/// to pull values from. The final write and read back of the output are saved, and values can
+	/// be read as soon as the earlier passes are done.
+	/// @param input Path of input file, or an input stream of unknown length.
+	/// @param work_path Path next to which temporary files are written. The last of them is
+	/// removed with the stream.
+	/// @return The stream. It can be iterated by range-based for.
+	template <class Input>
+	merge_ifbufstream<value_type, Mode> stream(Input&& input, const fs::path& work_path) {
+		auto src_path = merge_passes(input, work_path);
+		return {src_path, segments, final_block, true};
+	}
+
+	/// @brief Plan merges by a given device model, instead of measuring the device of the output.
+	void set_device(const device_model& model) { device = model; }
+
+private:
+	/// @brief Generate runs from the input, then merge them.
+	/// @param input Path of input file, or an input stream.
+	template <class Input>
+	void sort(Input&& input, const fs::path& output_path) {
+		auto src_path = merge_passes(input, output_path);
+		if (segments.size() <= 1) {
+			// Already sorted. No merge is needed.
+			fs::rename(src_path, output_path);
+			return;
 		}
-		// Continuously select the minimal element and output it.
-		size_t st = 0;
-		while (true) {
-			// Collect & allocate at intervals
-			if (++st == buffer_size_2) {
-				pool.collect_allocate();
-				st = 0;
-			}
-			auto [b, x, i] = lt.top();
-			if (b == 2)
-				break;		 // It indicates that the merge is completed. Then end loop.
-			output_buf << x; // Output.
-			if (pool[i]) {
-				// If this file is not exhausted, read in next value and push.
-				pool[i] >> x;
-				lt.push({1, x, i});
-			} else {
-				// Else push a virtual record. The value can be arbitrary.
-				lt.push({2, {}, i});
-			}
+		{
+			ofbufstream<value_type, double_buffer_tag> output_buf(final_block, output_path);
+			merge_group(src_path, 0, segments, output_buf, final_block);
 		}
-		pool.close();
-		fs::remove(tmp_path);
+		fs::remove(src_path);
 #ifdef LOGGING
-		m_log["pool"] = pool.get_log();
+		m_log["plan"]["actual"] =
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - merge_start).count();
 #endif
 	}
 
-	void operator()(const fs::path& input_path, const fs::path& output_path, int x) {
+	/// @brief Generate runs from the input, and merge them by all passes but the last.
+	/// @param input Path of input file, or an input stream.
+	/// @param output_path Path of output file, next to which temporary files are written.
+	/// @return Path of the file of remaining segments, to be merged by the last pass.
+	template <class Input>
+	fs::path merge_passes(Input&& input, const fs::path& output_path) {
 		auto tmp_path = output_path;
 		tmp_path.replace_filename(".merge");
-		segments = replacement_selection<value_type>(buffer_size)(
-			input_path, tmp_path); // Call replacement selection
+
+		run_generator<value_type, Mode, input_type> rungen(buffer_size);
+		segments = rungen(input, tmp_path); // Generate initial segments
+#ifdef LOGGING
+		m_log["runs"] = rungen.get_log();
+#endif
+		final_block = buffer_size;
+		if (segments.size() <= 1)
+			return tmp_path;
 
 		/// Now merge.
 
-		using ifbufstream_t = ifbufstream<value_type, double_buffer_tag>;
-		size_t merge_order = segments.size();						   // Merge order
-		std::vector<ifbufstream_t> inputs(merge_order, {buffer_size}); // Input buffers.
-		ofbufstream<value_type, double_buffer_tag> output_buf(buffer_size,
-															  output_path); // Output buffer
-		// Init input buffers.
-		for (size_t sum = 0, i = 0; i < merge_order; i++) {
-			inputs[i].open(tmp_path);
-			inputs[i].seek(sum, sum + segments[i]);
-			sum += +segments[i];
+		size_t total = fs::file_size(tmp_path) / sizeof(value_type);
+		// Plan passes with fan-in bounded by page-sized blocks and by open files, and the buffer size
+		// of each run.
+		merge_start = std::chrono::steady_clock::now();
+		size_t budget = buffer_size * 2;
+		size_t min_block = std::max(min_block_bytes / sizeof(value_type), (size_t)1);
+		merge_planner planner(device ? *device : device_model::measured(output_path.parent_path()),
+							  budget, sizeof(value_type));
+		size_t max_fan_in = std::min(std::max(budget / min_block, (size_t)3) - 1, max_open_files());
+		merge_plan plan = planner.plan(segments.size(), total, SIZE_MAX, max_fan_in);
+#ifdef LOGGING
+		m_log["plan"] = plan.to_json();
+#endif
+		// Each pass but the last merges groups of segments into the other temporary file.
+		auto src_path = tmp_path, dst_path = tmp_path;
+		dst_path.replace_filename(".merge_pass");
+		for (size_t p = 0; p + 1 < plan.passes(); p++) {
+			size_t k = plan.fan_in[p];
+			std::vector<run_segment> next;
+			ofbufstream<value_type, double_buffer_tag> output_buf(plan.block[p], dst_path);
+			for (size_t first = 0, offset = 0; first < segments.size(); first += k) {
+				std::span<const run_segment> group(segments.begin() + first,
+												   segments.begin() + std::min(first + k, segments.size()));
+				next.push_back({merge_group(src_path, offset, group, output_buf, plan.block[p]), false});
+				for (auto&& s : group)
+					offset += s.size;
+			}
+			output_buf.close();
+			std::swap(src_path, dst_path);
+			segments = std::move(next);
 		}
+		if (fs::exists(dst_path))
+			fs::remove(dst_path);
+		final_block = plan.block.back();
+		return src_path;
+	}
 
-		// Loser tree. The 0-th of each element marks whether it is virtual.
-		loser_tree<std::tuple<bool, value_type, int>> lt(merge_order);
-		// Initialize loser tree
-		for (ssize_t i = merge_order - 1; i >= 0; i--) {
-			value_type x;
-			inputs[i] >> x;
-			lt.push_at({0, x, i}, i);
-		}
+	/// @brief Merge all segments by a selector, stopping after all elements are output.
+	/// @tparam Selector Loser tree or other selector of minimum.
+	/// @tparam Word Word held by the selector, see `merge_word`.
+	/// @param inputs Input buffers of segments, or the buffer pool.
+	/// @param k Number of segments.
+	/// @param output_buf Output buffer, or a writer collapsing equal values.
+	/// @param total Total number of elements.
+	/// @param interval Interval of elements to collect & allocate buffers of the pool.
+	template <class Selector, class Word, class Inputs, class Output>
+	void merge(Inputs& inputs, size_t k, Output& output_buf, size_t total, size_t interval = 0) {
+		// Initialize loser tree with heads of all segments.
+		std::vector<typename Word::word_type> heads(k);
+		for (size_t i = 0; i < heads.size(); i++)
+			heads[i] = Word::make(inputs[i].get(), i);
+		Selector lt(heads);
 		// Continuously select the minimal element and output it.
-		while (true) {
-			auto [b, x, i] = lt.top();
-			if (b)
-				break;		 // It indicates that the merge is completed. Then end loop.
-			output_buf << x; // Output.
+		for (size_t st = 0; total > 0; total--) {
+			if constexpr (requires { inputs.collect_allocate(); }) {
+				// Collect & allocate at intervals
+				if (++st == interval) {
+					inputs.collect_allocate();
+					st = 0;
+				}
+			}
+			size_t i = lt.top_index();
+			output_buf << Word::value(lt.top()); // Output.
 			if (inputs[i]) {
 				// If this file is not exhausted, read in next value and push.
+				value_type x;
 				inputs[i] >> x;
-				lt.push({0, x, i});
+				lt.push(Word::make(x, i));
 			} else {
-				// Else push a virtual record. The value can be arbitrary.
-				lt.push({1, {}, i});
+				// Else push the sentinel, which never wins before the remaining elements.
+				lt.push(Word::exhausted(i));
 			}
 		}
 	}
 
-private:
-	/// @brief Length of segments to be merged.
-	std::vector<size_t> segments;
+	/// @brief Merge a group of consecutive segments of a file.
+	/// @param path Path of the file.
+	/// @param offset Position of the first segment.
+	/// @param group Segments.
+	/// @param block Buffer size of each segment.
+	/// @return Number of elements written.
+	size_t merge_group(const fs::path& path, size_t offset, std::span<const run_segment> group,
+					   ofbufstream<value_type, double_buffer_tag>& output_buf, size_t block) {
+		size_t k = group.size(), total = 0;
+		for (auto&& s : group)
+			total += s.size;
+		if (k == 1) {
+			// Copy a single segment, which may be read backward.
+			ifbufstream<value_type, basic_buffer_tag> input_buf(block);
+			input_buf.open(path);
+			input_buf.set_backward(group[0].descending);
+			input_buf.seek(offset, offset + total);
+			while (input_buf) {
+				value_type x;
+				input_buf >> x;
+				output_buf << x;
+			}
+			return total;
+		}
+		reducing_writer<value_type, Mode, ofbufstream<value_type, double_buffer_tag>> out(output_buf);
+		if (k >= large_order) {
+			merge_large(path, offset, group, out, block);
+			return out.flush();
+		}
+		ifbufstream_pool<value_type> pool(k, block); // Buffer pool
+		// Init input buffers.
+		for (size_t sum = offset, i = 0; i < k; i++) {
+			pool[i].open(path);
+			pool[i].set_backward(group[i].descending);
+			pool[i].seek(sum, sum + group[i].size);
+			sum += group[i].size;
+		}
+		pool.collect_allocate(); // Maybe this is important
+
+		if constexpr (small_order > 0) {
+			if (k >= min_small_order && k <= small_order) {
+				merge<tournament_selector<typename word::entry>, word>(pool, k, out, total, block);
+			} else {
+				merge<tree_type, word>(pool, k, out, total, block);
+			}
+		} else {
+			merge<tree_type, word>(pool, k, out, total, block);
+		}
+		pool.close();
+#ifdef LOGGING
+		m_log["pool"] = pool.get_log();
+		m_log["selector"] =
+			k >= min_small_order && k <= small_order ? "tournament" : "loser_tree";
+#endif
+		return out.flush();
+	}
+
+	/// @brief Merge thousands of segments by a two-level merger.
+	/// Each segment has a plain input buffer, since groups read ahead of the global order.
+	template <class Output>
+	void merge_large(const fs::path& path, size_t offset, std::span<const run_segment> group,
+					 Output& output_buf, size_t block) {
+		using ifbufstream_t = ifbufstream<value_type, basic_buffer_tag>;
+		std::vector<ifbufstream_t> inputs(group.size(), {block}); // Input buffers
+		std::vector<size_t> sizes;
+		size_t total = 0;
+		for (size_t sum = offset, i = 0; i < group.size(); i++) {
+			inputs[i].open(path);
+			inputs[i].set_backward(group[i].descending);
+			inputs[i].seek(sum, sum + group[i].size);
+			sum += group[i].size;
+			sizes.push_back(group[i].size);
+			total += group[i].size;
+		}
+		two_level_merger<value_type, std::vector<ifbufstream_t>> merger(inputs, sizes);
+		for (size_t n = total; n > 0; n--)
+			output_buf << merger.pop();
+		for (auto&& input : inputs)
+			input.close();
+#ifdef LOGGING
+		m_log["selector"] = "two_level";
+		m_log["groups"] = merger.group_count();
+#endif
+	}
+
+	/// @brief Segments to be merged.
+	std::vector<run_segment> segments;
+	/// @brief Buffer size of each segment in the last pass.
+	size_t final_block = 0;
+	/// @brief Time when merge starts.
+	std::chrono::steady_clock::time_point merge_start;
+	/// @brief Device model to plan merges by, or none to measure it.
+	std::optional<device_model> device;
 };
 
 } // namespace qy
\ No newline at end of file
@@ -1,21 +1,31 @@
 #pragma once
 #include "./base_sorter.hpp"
+#include "./external_multiway_merge_sort.hpp"
 #include "bufio/arraybuf.hpp"
+#include "bufio/bounded_istream.hpp"
 #include "ds/interval_heap.hpp"
 #include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstring>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace qy {
 
 /// @brief External sorting implemented by quick sort
 /// @tparam T Value type of sorted file
-/// @tparam buffer_size Buffer size, aka number of buffer elements
-template <class T>
+/// @tparam Tag Buffer tag. With double buffer, partitioning overlaps with I/O.
+template <class T, class Tag = double_buffer_tag>
 class external_quick_sorter : public base_sorter {
-	using buffer_type = arraybuf<T>;
+	using buffer_type = arraybuf<T, Tag>;
 
 	constexpr static size_t value_size = sizeof(T);
 
+	/// @brief A split is bad if its larger side takes more than this ratio of the partition.
+	constexpr static double max_split_ratio = 0.875;
+
 public:
 	using value_type = T;
 
@@ -28,27 +38,54 @@ public:
 		small_buf(buffer_size),
 		large_buf(buffer_size, true) {}
 
-	external_quick_sorter(size_t buffer_size) :
-		base_sorter(buffer_size),
-		input_buf(buffer_size),
-		small_buf(buffer_size),
-		large_buf(buffer_size, true) {}
+	external_quick_sorter(size_t buffer_size) : external_quick_sorter(buffer_size, buffer_size) {}
+
+	/// @brief Get the number of elements the middle group is filled with.
+	/// It holds at least three blocks: the one being partitioned, the one being prefetched, and
+	/// room for the former to go entirely to either side.
+	inline size_t middle_capacity() const { return std::max(heap_size, buffer_size * 3); }
 
 	/// @brief Sort array in binary file.
 	/// @param input_path Path of input file.
 	/// @param output_path Path of output file.
 	void operator()(const fs::path& input_path, const fs::path& output_path) {
+		(*this)(input_path, output_path, 0, SIZE_MAX);
+	}
+
+	/// @brief Sort only the ranks in [rank_first, rank_last) of the output. Partitions out of them
+	/// are discarded instead of recursed into, and left unsorted in the output.
+	/// @param input_path Path of input file.
+	/// @param output_path Path of output file.
+	/// @param rank_first First rank to sort.
+	/// @param rank_last Last rank to sort.
+	void operator()(const fs::path& input_path, const fs::path& output_path, size_t rank_first,
+					size_t rank_last) {
+		(*this)(input_path, output_path, {{rank_first, rank_last}});
+	}
+
+	/// @brief Sort only the ranks in some ranges of the output, as needed to select many ranks at
+	/// once. Partitions out of all ranges are discarded.
+	/// @param input_path Path of input file.
+	/// @param output_path Path of output file.
+	/// @param rank_ranges Sorted and disjoint ranges [first, last) of ranks to sort.
+	void operator()(const fs::path& input_path, const fs::path& output_path,
+					std::vector<std::pair<size_t, size_t>> rank_ranges) {
+		this->rank_ranges = std::move(rank_ranges);
+		merge_path = output_path;
+		merge_path.replace_filename(".quick_merge");
 		// Open files
-		ftemp.open(output_path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
 		finput.open(input_path, std::ios_base::binary | std::ios_base::in);
 		foutput.open(output_path, std::ios_base::binary | std::ios_base::in | std::ios_base::out |
 									  std::ios_base::trunc);
-		assert(ftemp.is_open());
-		assert(finput.is_open());
-		assert(foutput.is_open());
 		// Get input size
 		size_t src_size = fs::file_size(input_path);
 		fs::resize_file(output_path, src_size);
+		ftemp.open(output_path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		freread.open(output_path, std::ios_base::binary | std::ios_base::in);
+		assert(ftemp.is_open());
+		assert(finput.is_open());
+		assert(foutput.is_open());
+		assert(freread.is_open());
 		// Bind buffer to stream
 		input_buf.bind(&finput);
 		small_buf.bind(&foutput);
@@ -56,12 +93,19 @@ public:
 #ifdef LOGGING
 		clear_log();
 		m_log["rec"] = 0;
+		m_log["mem"] = 0;
+		m_log["skew"] = 0;
+		m_log["fallback"] = 0;
+		m_log["discarded"] = 0;
 		m_log["heap_size"] = heap_size;
 #endif
-		// Perform sorting
-		_sort(0, src_size / value_size, true);
+		// Perform sorting. Like introsort, the depth is limited to twice of the balanced case.
+		size_t n = src_size / value_size;
+		_sort(0, n, 2 * std::bit_width(n / middle_capacity()), true);
 		// End with closing stream
 		finput.close();
+		freread.close();
+		ftemp.close();
 		foutput.close();
 #ifdef LOGGING
 		m_log["input"] = input_buf.get_log();
@@ -70,17 +114,43 @@ public:
 #endif
 	}
 
+	/// @brief Plan merges of the merge sort fallback by a given device model, instead of measuring
+	/// the device of the output.
+	void set_device(const device_model& model) { device = model; }
+
 private:
-	void _sort(size_t first, size_t last, bool initial = false) {
+	/// @brief Sort a partition.
+	/// @param first First position of the partition.
+	/// @param last Last position of the partition.
+	/// @param depth Remaining depth budget. Merge sort takes over when it runs out.
+	/// @param initial Whether it is the first run, when data is still in input file.
+	void _sort(size_t first, size_t last, size_t depth, bool initial = false) {
 		if (first >= last)
 			return;
+		// Ranks out of interest are left as they are.
+		if (!wanted(first, last)) {
+#ifdef LOGGING
+			this->jinc("discarded");
+#endif
+			return;
+		}
+		// A partition that fits in memory is sorted in one go, without partitioning.
+		if (last - first <= middle_capacity()) {
+			_sort_in_memory(first, last, initial);
+			return;
+		}
+		// Too many bad splits on the way. Avoid quadratic I/O.
+		if (depth == 0) {
+			_merge_sort(first, last);
+			return;
+		}
 		// Fill middle group
 		size_t input_size = std::min(last - first, buffer_size);
 		input_buf.load(first, input_size);
 		middle_heap = interval_heap<T>(input_buf.begin(), input_buf.begin() + input_size);
 		//middle_heap.validate();
 		size_t cur = first + input_size;
-		while (cur < last && cur - first < heap_size) { // Read another run to make room for output.
+		while (cur < last && cur - first < middle_capacity()) { // Read another run to make room for output.
 			input_size = std::min(last - cur, buffer_size);
 			input_buf.load(cur, input_size);
 			for (size_t i = 0; i < input_size; i++) {
@@ -93,33 +163,50 @@ private:
 		large_buf.seekp(last);
 		small_buf.seekp(first);
 		size_t mid1 = first, mid2 = last, cur2 = last;
+		// Values identical to the bounds of middle group are held back and only counted, then
+		// written next to the middle group, so that they are never partitioned again.
+		// The minimum only grows, and the maximum never changes during partitioning.
+		T lo = middle_heap.top_min(), hi = middle_heap.top_max();
+		size_t lo_cnt = 0, hi_cnt = 0;
+		auto to_small = [&](const T& value) {
+			if (identical(value, lo))
+				++lo_cnt;
+			else
+				small_buf << value;
+			++mid1;
+		};
+		auto to_large = [&](const T& value) {
+			if (identical(value, hi))
+				++hi_cnt;
+			else
+				large_buf << value;
+			--mid2;
+		};
 		// Repeat until read in all input data
-		// It read data from both sides as needed.
-		while (cur < cur2) {
-			// 这边还要检查是否加载过多
-			if (cur + buffer_size >= cur2 || cur - mid1 <= mid2 - cur2) {
-				input_size = std::min(buffer_size, cur2 - cur);
-				input_buf.load(cur, input_size);
-				cur += input_size;
-			} else {
-				input_size = buffer_size;
-				cur2 -= input_size;
-				input_buf.load(cur2, input_size);
-			}
+		// It read data from both sides as needed. The next block is prefetched before partitioning
+		// the current one, so the side is chosen before knowing where the current block goes.
+		size_t next_size = prefetch_next(cur, cur2, mid1, mid2);
+		while (next_size > 0) {
+			input_buf.fetch();
+			input_size = next_size;
+			next_size = prefetch_next(cur, cur2, mid1, mid2);
 			for (size_t i = 0; i < input_size; i++) {
 				T value = input_buf[i];
 				if (value <= middle_heap.top_min()) {
-					small_buf << value;
-					++mid1;
-				} else if (value >= middle_heap.top_max()) {
-					large_buf << value;
-					--mid2;
+					to_small(value);
+				} else if (value >= hi) {
+					to_large(value);
 				} else {
 					// Replace the minimum element in middle group
-					small_buf << middle_heap.top_min();
-					++mid1;
+					to_small(middle_heap.top_min());
 					middle_heap.pop_min();
 					middle_heap.push(value);
+					// The held back values are no longer next to the middle group. Release them.
+					if (!identical(middle_heap.top_min(), lo)) {
+						for (; lo_cnt > 0; lo_cnt--)
+							small_buf << lo;
+						lo = middle_heap.top_min();
+					}
 				}
 #ifdef DEBUG
 				if (cur != cur2 && (mid1 > cur || mid2 < cur2)) {
@@ -131,6 +218,10 @@ private:
 		// Write back all data in buffer
 		//small_buf.dump();
 		large_buf.dump();
+		// It writes backward block by block, so held back values go in blocks of their own.
+		for (size_t i = 0; i < hi_cnt; i++)
+			large_buf << hi;
+		large_buf.dump();
 
 #ifdef DEBUG
 		assert(first <= mid1);
@@ -138,6 +229,8 @@ private:
 		assert(mid2 <= last);
 #endif
 		// Now middle follows small. Write back directly.
+		for (size_t i = 0; i < lo_cnt; i++)
+			small_buf << lo;
 		for (size_t i = mid1; i < mid2; i++) {
 			small_buf << middle_heap.top_min();
 			middle_heap.pop_min();
@@ -149,12 +242,91 @@ private:
 #endif
 		// Rebind input buffer to output file after the first run
 		if (initial)
-			input_buf.bind(&foutput);
+			input_buf.bind(&freread);
 #ifdef LOGGING
 		this->jinc("rec");
 #endif
-		_sort(first, mid1);
-		_sort(mid2, last);
+		// A bad split burns the depth budget faster.
+		size_t n = last - first;
+		if (std::max(mid1 - first, last - mid2) > n * max_split_ratio) {
+			depth /= 2;
+#ifdef LOGGING
+			this->jinc("skew");
+#endif
+		} else {
+			depth--;
+		}
+		_sort(first, mid1 - lo_cnt, depth);
+		_sort(mid2 + hi_cnt, last, depth);
+	}
+
+	/// @brief Check whether a partition holds any rank to sort.
+	inline bool wanted(size_t first, size_t last) const {
+		// The first range ending after the partition begins, as ranges are sorted and disjoint.
+		auto it = std::ranges::upper_bound(rank_ranges, first, {}, &std::pair<size_t, size_t>::second);
+		return it != rank_ranges.end() && it->first < last;
+	}
+
+	/// @brief Prefetch the next block from the side with less room, so that neither output side
+	/// overtakes its input.
+	/// @return Size of the prefetched block. 0 if all input has been read.
+	inline size_t prefetch_next(size_t& cur, size_t& cur2, size_t mid1, size_t mid2) {
+		if (cur >= cur2)
+			return 0;
+		size_t input_size = std::min(buffer_size, cur2 - cur);
+		if (cur - mid1 <= mid2 - cur2) {
+			input_buf.prefetch(cur, input_size);
+			cur += input_size;
+		} else {
+			cur2 -= input_size;
+			input_buf.prefetch(cur2, input_size);
+		}
+		return input_size;
+	}
+
+	/// @brief Load the whole partition, sort it in memory and write it back to output file.
+	/// @param first First position of the partition.
+	/// @param last Last position of the partition.
+	/// @param initial Whether it is the first run, when data is still in input file.
+	void _sort_in_memory(size_t first, size_t last, bool initial) {
+		std::fstream& source = initial ? finput : foutput;
+		size_t n = last - first;
+		memory_buf.resize(n);
+		source.seekg(first * value_size, source.beg);
+		source.read(reinterpret_cast<char*>(memory_buf.data()), n * value_size);
+		std::sort(memory_buf.begin(), memory_buf.end());
+		foutput.seekp(first * value_size, foutput.beg);
+		foutput.write(reinterpret_cast<const char*>(memory_buf.data()), n * value_size);
+#ifdef LOGGING
+		this->jinc("mem");
+#endif
+	}
+
+	/// @brief Sort a partition in output file by external merge sort, as fallback of bad splits.
+	/// The partition is read in place as the input stream of the multiway merge sorter, whose
+	/// passes bound fan-in by the buffer size and open files. Its last merge is streamed back into
+	/// the partition.
+	/// @param first First position of the partition.
+	/// @param last Last position of the partition.
+	void _merge_sort(size_t first, size_t last) {
+		external_multiway_merge_sorter<value_type> sorter(buffer_size);
+		if (device)
+			sorter.set_device(*device);
+		freread.seekg(first * value_size, freread.beg);
+		bounded_istream partition(freread, (last - first) * value_size);
+		auto sorted = sorter.stream(partition, merge_path);
+		small_buf.seekp(first);
+		for (auto&& x : sorted)
+			small_buf << x;
+		small_buf.dump();
+#ifdef LOGGING
+		this->jinc("fallback");
+#endif
+	}
+
+	/// @brief Check whether two values are bitwise identical, so that one can be written for another.
+	inline static bool identical(const T& a, const T& b) {
+		return std::memcmp(&a, &b, value_size) == 0;
 	}
 
 #ifdef DEBUG
@@ -184,11 +356,16 @@ private:
 
 private:
 	size_t heap_size;
+	fs::path merge_path;		  // Path next to which merge sort fallback writes temporary files
+	std::optional<device_model> device; // Device model of merge sort fallback, or none to measure
 	std::fstream finput;		  // Input file stream
 	std::fstream foutput;		  // Output file stream
 	std::fstream ftemp;			  // Temp file stream
+	std::fstream freread;		  // Output file stream for reading partitions back
 	interval_heap<T> middle_heap; // Heap (depq) for middle group
-	buffer_type input_buf;		  // Buffer for input, bound input or output file
+	std::vector<std::pair<size_t, size_t>> rank_ranges; // Ranges of ranks to sort
+	std::vector<T> memory_buf;	  // Whole partition for in-memory sorting
+	buffer_type input_buf;		  // Buffer for input, bound input file or `freread`
 	buffer_type small_buf;		  // Buffer for small, bound output file
 	buffer_type large_buf;		  // Buffer for large, bound temp file
 };
@@ -0,0 +1,174 @@
+#pragma once
+#include "./base_sorter.hpp"
+#include "./normalized_key.hpp"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace qy {
+
+/// @brief External MSD radix sort.
+/// Each pass distributes a range by one byte of the normalized key into 256 bucket files, from the
+/// most significant byte. Buckets fitting in the buffer are sorted in memory and written to the
+/// output at their prefix-summed offsets, and others recurse on the next byte. Thus the number of
+/// passes is bounded by the key width instead of the input size, and no sampling is needed. The
+/// first pass only scans its input forward, so it can also read a stream of unknown length.
+/// @tparam T Value type.
+template <normalizable T>
+class external_radix_sorter : public base_sorter {
+public:
+	using value_type = T;
+	using key_type = typename normalized_key<value_type>::type;
+	/// @brief Number of buckets of a pass.
+	constexpr static size_t radix = 256;
+	/// @brief Number of bytes of the key.
+	constexpr static size_t key_bytes = sizeof(key_type);
+	/// @brief Minimal buffer size of a bucket.
+	constexpr static size_t min_block = 16;
+
+	using base_sorter::base_sorter;
+
+	void operator()(const fs::path& input_path, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["passes"] = 0;
+		m_log["distributed"] = 0;
+		m_log["in_memory"] = 0;
+#endif
+		size_t n = fs::file_size(input_path) / sizeof(value_type);
+		bucket_path = output_path;
+		bucket_path.replace_filename(".radix");
+		std::ofstream(output_path, std::ios_base::binary | std::ios_base::trunc).close();
+		fs::resize_file(output_path, n * sizeof(value_type));
+		m_out.open(output_path, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		sort(input_path, n, 0, 0);
+		m_out.close();
+	}
+
+	/// @brief Sort values from an input stream of unknown length, such as stdin or a pipe.
+	/// The first pass distributes values as data arrives and counts them, and the output is sized
+	/// after it, so the input needs not be staged on disk first.
+	/// @param input Input stream, read until its end.
+	/// @param output_path Path of output file.
+	void operator()(std::istream& input, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["passes"] = 0;
+		m_log["distributed"] = 0;
+		m_log["in_memory"] = 0;
+#endif
+		bucket_path = output_path;
+		bucket_path.replace_filename(".radix");
+		bucket_files buckets;
+		{
+			istream_ifbufstream<value_type> input_buf(std::max(buffer_size / 2, min_block), input);
+			buckets = distribute(input_buf, 0);
+		}
+		size_t n = 0;
+		for (size_t c : buckets.counts)
+			n += c;
+		std::ofstream(output_path, std::ios_base::binary | std::ios_base::trunc).close();
+		fs::resize_file(output_path, n * sizeof(value_type));
+		m_out.open(output_path, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		sort(buckets, 0, 0);
+		m_out.close();
+	}
+
+private:
+	/// @brief Bucket files of a pass.
+	struct bucket_files {
+		std::array<size_t, radix> counts{}; // Number of values of each bucket
+		std::array<fs::path, radix> paths;	// Path of each bucket, empty if no value
+	};
+
+	/// @brief Byte of the key of a value at some depth, from the most significant one.
+	static size_t digit(value_type x, size_t depth) { return normalized_bytes(x)[depth]; }
+
+	/// @brief Sort all values of a file, and write them at an offset of the output.
+	/// @param path Path of the file.
+	/// @param n Number of values.
+	/// @param depth Index of the byte to distribute by.
+	/// @param offset Offset of the output, in number of elements.
+	void sort(const fs::path& path, size_t n, size_t depth, size_t offset) {
+		if (n <= buffer_size || depth == key_bytes) {
+			sort_in_memory(path, n, offset);
+			return;
+		}
+		bucket_files buckets;
+		{
+			ifbufstream<value_type, basic_buffer_tag> input_buf(std::max(buffer_size / 2, min_block));
+			input_buf.open(path);
+			input_buf.seek(0, n);
+			buckets = distribute(input_buf, depth);
+		}
+		sort(buckets, depth, offset);
+	}
+
+	/// @brief Sort buckets in order, each at the offset after all preceding buckets, and remove
+	/// them.
+	/// @param depth Index of the byte the buckets are distributed by.
+	void sort(const bucket_files& buckets, size_t depth, size_t offset) {
+		for (size_t b = 0; b < radix; b++) {
+			if (buckets.counts[b] == 0)
+				continue;
+			sort(buckets.paths[b], buckets.counts[b], depth + 1, offset);
+			fs::remove(buckets.paths[b]);
+			offset += buckets.counts[b];
+		}
+	}
+
+	/// @brief Distribute values by a byte into bucket files, opened as values arrive.
+	/// @param input_buf Input buffer, read forward until its end.
+	/// @param depth Index of the byte to distribute by.
+	template <class Input>
+	bucket_files distribute(Input& input_buf, size_t depth) {
+#ifdef LOGGING
+		m_log["passes"] = std::max(m_log["passes"].get<size_t>(), depth + 1);
+		jinc("distributed");
+#endif
+		bucket_files result;
+		size_t block = std::max(buffer_size / (radix + 1), min_block);
+		std::array<std::unique_ptr<ofbufstream<value_type, basic_buffer_tag>>, radix> buckets;
+		while (input_buf) {
+			value_type x;
+			input_buf >> x;
+			size_t b = digit(x, depth);
+			if (!buckets[b]) {
+				result.paths[b] = bucket_path;
+				result.paths[b] += "_" + std::to_string(depth) + "_" + std::to_string(b);
+				buckets[b] = std::make_unique<ofbufstream<value_type, basic_buffer_tag>>(
+					block, result.paths[b]);
+			}
+			*buckets[b] << x;
+			result.counts[b]++;
+		}
+		return result;
+	}
+
+	/// @brief Sort a file in memory by normalized keys, and write it at an offset of the output.
+	/// A file larger than the buffer only holds values of equal keys, so it is sorted by chunks.
+	void sort_in_memory(const fs::path& path, size_t n, size_t offset) {
+		std::vector<value_type> buf(std::min(n, std::max(buffer_size, (size_t)1)));
+		std::ifstream fin(path, std::ios_base::binary);
+		m_out.seekp(offset * sizeof(value_type), std::ios_base::beg);
+		for (size_t i = 0; i < n; i += buf.size()) {
+			size_t m = std::min(buf.size(), n - i);
+			fin.read(reinterpret_cast<char*>(buf.data()), m * sizeof(value_type));
+			std::ranges::sort(buf.begin(), buf.begin() + m, {},
+							  [](value_type x) { return normalize(x); });
+			m_out.write(reinterpret_cast<const char*>(buf.data()), m * sizeof(value_type));
+		}
+#ifdef LOGGING
+		jinc("in_memory");
+#endif
+	}
+
+	/// @brief Prefix of paths of bucket files.
+	fs::path bucket_path;
+	/// @brief The output file stream.
+	std::fstream m_out;
+};
+
+} // namespace qy
@@ -0,0 +1,150 @@
+#pragma once
+#include "./base_sorter.hpp"
+#include "./external_multiway_merge_sort.hpp"
+#include "./keyed_record.hpp"
+#include "./normalized_key.hpp"
+#include <algorithm>
+
+namespace qy {
+
+/// @brief External sorting of records by a projected key.
+/// In direct mode, records are moved through the sorter as a whole.
+/// In indirect mode, only compact (key, offset) entries are sorted, then records are permuted
+/// to their place in one pass, so that wide payloads are not moved at every merge level.
+/// @tparam R Record type.
+/// @tparam Proj Key projection, such as a pointer to data member.
+/// @tparam Compare Comparator of keys.
+/// @tparam Sorter The underlying sorter.
+template <class R, auto Proj = std::identity{}, class Compare = std::less<>,
+		  template <class> class Sorter = external_multiway_merge_sorter>
+class external_record_sorter : public base_sorter {
+public:
+	using value_type = R;
+	using record_type = keyed_record<R, Proj, Compare>;
+	using key_type = record_type::key_type;
+
+	/// @brief Whether keys are stored normalized in index entries, so that they compare as
+	/// unsigned integers.
+	constexpr static bool normalized = normalizable<key_type> &&
+									   (std::is_same_v<Compare, std::less<>> ||
+										std::is_same_v<Compare, std::less<key_type>>);
+
+	/// @brief Index entry of a record, sorted instead of the record in indirect mode.
+	/// Ties are broken by offset, so that the sort is stable.
+	struct index_entry {
+		std::conditional_t<normalized, normalized_key<key_type>, std::type_identity<key_type>>::type
+			key;
+		uint64_t offset; // Position of the record, in elements
+
+		inline friend std::weak_ordering operator<=>(const index_entry& lhs,
+													 const index_entry& rhs) {
+			if constexpr (normalized)
+				return std::tie(lhs.key, lhs.offset) <=> std::tie(rhs.key, rhs.offset);
+			Compare comp;
+			if (comp(lhs.key, rhs.key))
+				return std::weak_ordering::less;
+			if (comp(rhs.key, lhs.key))
+				return std::weak_ordering::greater;
+			return lhs.offset <=> rhs.offset;
+		}
+
+		inline friend bool operator==(const index_entry& lhs, const index_entry& rhs) {
+			return std::is_eq(lhs <=> rhs);
+		}
+	};
+
+	/// @brief Whether records are wide enough to be sorted indirectly by default.
+	constexpr static bool prefer_indirect = sizeof(R) >= 4 * sizeof(index_entry);
+
+	/// @brief Constructor
+	/// @param buffer_size Size of buffer, in records.
+	/// @param indirect Whether to sort indirectly.
+	external_record_sorter(size_t buffer_size, bool indirect = prefer_indirect) :
+		base_sorter(buffer_size), indirect(indirect) {}
+
+	/// @brief Sort records in binary file.
+	/// @param input_path Path of input file.
+	/// @param output_path Path of output file.
+	void operator()(const fs::path& input_path, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["indirect"] = indirect;
+#endif
+		if (!indirect) {
+			Sorter<record_type> sorter(buffer_size);
+			sorter(input_path, output_path);
+#ifdef LOGGING
+			m_log["sorter"] = sorter.get_log();
+#endif
+			return;
+		}
+		auto index_path = output_path;
+		index_path.replace_filename(".index");
+		auto sorted_index_path = output_path;
+		sorted_index_path.replace_filename(".index_sorted");
+		extract(input_path, index_path);
+		// Index entries are sorted with the same memory as records.
+		Sorter<index_entry> sorter(buffer_size * sizeof(R) / sizeof(index_entry));
+		sorter(index_path, sorted_index_path);
+		permute(input_path, sorted_index_path, output_path);
+		fs::remove(index_path);
+		fs::remove(sorted_index_path);
+#ifdef LOGGING
+		m_log["sorter"] = sorter.get_log();
+#endif
+	}
+
+private:
+	/// @brief Write index entries of all records in input file.
+	void extract(const fs::path& input_path, const fs::path& index_path) {
+		ifbufstream<record_type, double_buffer_tag> input_buf(buffer_size, input_path);
+		ofbufstream<index_entry, double_buffer_tag> index_buf(buffer_size, index_path);
+		input_buf.seek(0);
+		for (uint64_t i = 0; input_buf; i++) {
+			if constexpr (normalized)
+				index_buf << index_entry{normalize(input_buf.get().key()), i};
+			else
+				index_buf << index_entry{input_buf.get().key(), i};
+		}
+	}
+
+	/// @brief Move records to their sorted positions, by windows of `buffer_size` records.
+	/// In each window, records are gathered in file order, and consecutive ones are read at once.
+	void permute(const fs::path& input_path, const fs::path& index_path,
+				 const fs::path& output_path) {
+		ifbufstream<index_entry, double_buffer_tag> index_buf(buffer_size, index_path);
+		index_buf.seek(0);
+		std::ifstream fin(input_path, std::ios_base::binary);
+		std::ofstream fout(output_path, std::ios_base::binary | std::ios_base::trunc);
+		std::vector<std::pair<uint64_t, size_t>> window; // Offset and slot of each record
+		std::vector<R> records(buffer_size), gathered(buffer_size);
+		size_t reads = 0;
+		while (index_buf) {
+			window.clear();
+			for (size_t slot = 0; slot < buffer_size && index_buf; slot++) {
+				window.push_back({index_buf.get().offset, slot});
+			}
+			std::ranges::sort(window);
+			for (size_t i = 0, j; i < window.size(); i = j) {
+				for (j = i + 1; j < window.size() && window[j].first == window[j - 1].first + 1; j++)
+					;
+				fin.seekg(window[i].first * sizeof(R), std::ios_base::beg);
+				fin.read(reinterpret_cast<char*>(gathered.data()), (j - i) * sizeof(R));
+				for (size_t k = i; k < j; k++) {
+					records[window[k].second] = gathered[k - i];
+				}
+				reads++;
+			}
+			fout.write(reinterpret_cast<const char*>(records.data()), window.size() * sizeof(R));
+		}
+#ifdef LOGGING
+		m_log["permute_reads"] = reads;
+#endif
+	}
+
+private:
+	/// @brief Whether to sort indirectly.
+	bool indirect;
+};
+
+} // namespace qy
@@ -0,0 +1,88 @@
+#pragma once
+#include "./external_quick_sort.hpp"
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <stdexcept>
+
+namespace qy {
+
+/// @brief External selection of values at some ranks, as `nth_element` of a file.
+/// The quick sorter partitions the input around its middle group, but only recurses into
+/// partitions holding requested ranks, so that each rank costs a geometric series of shrinking
+/// sequential passes instead of a full sort. All ranks are selected in one run, sharing the passes
+/// over partitions they have in common. Values are read back from a temporary work file next to a
+/// given work path, which is removed afterwards.
+/// @tparam T Value type.
+/// @tparam Tag Buffer tag.
+template <class T, class Tag = double_buffer_tag>
+class external_selector : public base_sorter {
+public:
+	using value_type = T;
+
+	using base_sorter::base_sorter;
+
+	/// @brief Select values at some ranks of the sorted input.
+	/// @param input_path Path of input file.
+	/// @param ranks Ranks to select, in any order.
+	/// @param work_path Path next to which the temporary work file is written.
+	/// @return Values at the ranks, in the order of requests.
+	/// @throw std::out_of_range If a rank is not less than the number of values.
+	std::vector<value_type> operator()(const fs::path& input_path, std::span<const size_t> ranks,
+									   const fs::path& work_path) {
+#ifdef LOGGING
+		clear_log();
+#endif
+		size_t n = fs::file_size(input_path) / sizeof(value_type);
+		std::vector<size_t> sorted(ranks.begin(), ranks.end());
+		std::ranges::sort(sorted);
+		if (!sorted.empty() && sorted.back() >= n)
+			throw std::out_of_range("Rank " + std::to_string(sorted.back()) + " of " +
+									std::to_string(n) + " values.");
+		auto [last, _] = std::ranges::unique(sorted);
+		sorted.erase(last, sorted.end());
+		std::vector<std::pair<size_t, size_t>> rank_ranges;
+		for (size_t r : sorted)
+			rank_ranges.emplace_back(r, r + 1);
+
+		fs::path tmp_path = work_path;
+		tmp_path.replace_filename(".select");
+		external_quick_sorter<value_type, Tag> sorter(buffer_size);
+		sorter(input_path, tmp_path, std::move(rank_ranges));
+		// Partitions of requested ranks are sorted in place, so each rank is at its position.
+		std::vector<value_type> values(ranks.size());
+		{
+			std::ifstream fin(tmp_path, std::ios_base::binary);
+			for (size_t i = 0; i < ranks.size(); i++) {
+				fin.seekg(ranks[i] * sizeof(value_type), std::ios_base::beg);
+				fin.read(reinterpret_cast<char*>(&values[i]), sizeof(value_type));
+			}
+		}
+		fs::remove(tmp_path);
+#ifdef LOGGING
+		m_log["ranks"] = sorted.size();
+		m_log["quick"] = sorter.get_log();
+#endif
+		return values;
+	}
+
+	/// @brief Select quantiles of the input, e.g. 0.5, 0.99 and 0.999 for p50, p99 and p999.
+	/// The quantile p is the value at rank floor(p * (n - 1)), without interpolation.
+	/// @param input_path Path of input file.
+	/// @param ps Quantiles in [0, 1], in any order.
+	/// @param work_path Path next to which the temporary work file is written.
+	/// @return Values of the quantiles, in the order of requests.
+	/// @throw std::out_of_range If the input is empty.
+	std::vector<value_type> quantiles(const fs::path& input_path, std::span<const double> ps,
+									  const fs::path& work_path) {
+		size_t n = fs::file_size(input_path) / sizeof(value_type);
+		if (n == 0 && !ps.empty())
+			throw std::out_of_range("Quantiles of an empty input.");
+		std::vector<size_t> ranks;
+		for (double p : ps)
+			ranks.push_back(std::min(n - 1, (size_t)std::floor(std::clamp(p, 0.0, 1.0) * (n - 1))));
+		return (*this)(input_path, ranks, work_path);
+	}
+};
+
+} // namespace qy
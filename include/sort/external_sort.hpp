@@ -0,0 +1,229 @@
+#pragma once
+#include "./external_counting_sort.hpp"
+#include "./external_multiway_merge_sort.hpp"
+#include "./external_quick_sort.hpp"
+#include "./external_radix_sort.hpp"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace qy {
+
+/// @brief Strategies of `auto_sorter`.
+enum class sort_strategy {
+	in_memory, // Input fits in the budget, sorted by `std::sort`
+	counting,  // Values of a small domain, see `external_counting_sorter`
+	quick,	   // Few distinct values, which three-way partitions settle at once
+	multiway,  // Presorted input or values without normalized keys
+	radix	   // Other values with normalized keys, given enough memory for buckets
+};
+
+inline const char* to_string(sort_strategy s) {
+	constexpr const char* names[] = {"in_memory", "counting", "quick", "multiway", "radix"};
+	return names[static_cast<size_t>(s)];
+}
+
+/// @brief External sort choosing its algorithm from a sample of the input.
+/// The size, the key type, the presortedness and the duplicate ratio of evenly spaced blocks decide
+/// the cheapest sorter, in this order: input that fits in memory is sorted in memory, a small
+/// domain is counted, presorted input is merged from its natural runs, few distinct values are
+/// partitioned by quick sort, and others go to radix sort if they have normalized keys and the
+/// budget holds its buckets, or to multiway merge sort otherwise. The decision and its inputs are
+/// logged, so that thresholds can be tuned.
+/// @tparam T Value type.
+template <class T>
+class auto_sorter : public base_sorter {
+public:
+	using value_type = T;
+	constexpr static size_t value_size = sizeof(value_type);
+	/// @brief Minimal fraction of monotone adjacent pairs in samples to merge natural runs.
+	constexpr static double presorted_ratio = 0.9;
+	/// @brief Maximal fraction of distinct values in samples to sort by quick sort.
+	constexpr static double few_distinct_ratio = 1.0 / 16;
+	/// @brief Number of blocks sampled.
+	constexpr static size_t sample_count = 16;
+	/// @brief Minimal buffer size of each bucket to sort by radix sort, below which it takes more
+	/// passes than merging.
+	constexpr static size_t radix_min_block = 64;
+
+	/// @param budget Memory budget in bytes. Each sorter gets a buffer size roughly within it.
+	auto_sorter(size_t budget) :
+		base_sorter(std::max(budget / value_size, (size_t)16)), budget(budget) {}
+
+	void operator()(const fs::path& input_path, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+#endif
+		size_t n = fs::file_size(input_path) / value_size;
+#ifdef LOGGING
+		m_log["n"] = n;
+		m_log["budget"] = budget;
+		m_log["small_domain"] = small_domain<value_type>;
+		m_log["normalizable"] = normalizable<value_type>;
+#endif
+		if (n <= buffer_size)
+			m_strategy = sort_strategy::in_memory;
+		else if (small_domain<value_type>)
+			m_strategy = sort_strategy::counting;
+		else {
+			auto [presorted, distinct] = sample(input_path, n);
+#ifdef LOGGING
+			m_log["presorted"] = presorted;
+			m_log["distinct"] = distinct;
+#endif
+			if (presorted >= presorted_ratio)
+				m_strategy = sort_strategy::multiway;
+			else if (distinct <= few_distinct_ratio)
+				m_strategy = sort_strategy::quick;
+			else if (radix_fits())
+				m_strategy = sort_strategy::radix;
+			else
+				m_strategy = sort_strategy::multiway;
+		}
+		dispatch(input_path, output_path);
+	}
+
+	/// @brief Sort values from an input stream of unknown length, such as stdin or a pipe.
+	/// It cannot be sampled, so a small domain is counted, and others go to multiway merge sort,
+	/// which builds runs as data arrives.
+	void operator()(std::istream& input, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["budget"] = budget;
+		m_log["stream"] = true;
+#endif
+		m_strategy = small_domain<value_type> ? sort_strategy::counting : sort_strategy::multiway;
+		dispatch(input, output_path);
+	}
+
+	/// @brief Get the strategy of the last sort.
+	sort_strategy strategy() const { return m_strategy; }
+
+private:
+	/// @brief Sort by the chosen strategy, with a buffer size of each sorter within the budget.
+	/// @param input Path of input file, or an input stream.
+	/// @throw std::logic_error If the strategy cannot sort the value type or the input.
+	template <class Input>
+	void dispatch(Input&& input, const fs::path& output_path) {
+#ifdef LOGGING
+		m_log["strategy"] = to_string(m_strategy);
+#endif
+		switch (m_strategy) {
+		case sort_strategy::in_memory:
+			if constexpr (std::is_convertible_v<Input, const fs::path&>)
+				sort_in_memory(input, output_path);
+			else
+				unsupported();
+			break;
+		case sort_strategy::counting:
+			if constexpr (small_domain<value_type>)
+				run(external_counting_sorter<value_type>(buffer_size), input, output_path);
+			else
+				unsupported();
+			break;
+		case sort_strategy::quick:
+			if constexpr (std::is_convertible_v<Input, const fs::path&>)
+				// Six buffers of I/O, and the middle group of three.
+				run(external_quick_sorter<value_type>(buffer_size / 9), input, output_path);
+			else
+				unsupported();
+			break;
+		case sort_strategy::multiway:
+			// Run generation and merge each hold about twice the buffer size.
+			run(external_multiway_merge_sorter<value_type>(buffer_size / 4), input, output_path);
+			break;
+		case sort_strategy::radix:
+			if constexpr (normalizable<value_type>)
+				// Input buffer of half and all bucket buffers of another.
+				run(external_radix_sorter<value_type>(buffer_size / 2), input, output_path);
+			else
+				unsupported();
+			break;
+		}
+	}
+
+	/// @brief Reject a strategy that does not fit the value type or the input.
+	[[noreturn]] void unsupported() const {
+		throw std::logic_error(std::string("Strategy ") + to_string(m_strategy) +
+							   " cannot sort this input.");
+	}
+
+	/// @brief Whether values have normalized keys, and the budget holds large enough buckets.
+	bool radix_fits() const {
+		if constexpr (normalizable<value_type>)
+			return buffer_size / 2 >= external_radix_sorter<value_type>::radix * radix_min_block;
+		else
+			return false;
+	}
+
+	/// @brief Run a sorter, and log it.
+	template <class Sorter, class Input>
+	void run(Sorter&& sorter, Input&& input, const fs::path& output_path) {
+		sorter(input, output_path);
+#ifdef LOGGING
+		m_log["sorter"] = sorter.get_log();
+		m_log["buffer_size"] = sorter.get_buffersize();
+#endif
+	}
+
+	/// @brief Estimate presortedness and the duplicate ratio by evenly spaced blocks.
+	/// @return Average fraction of adjacent pairs in the dominant direction of each block, and the
+	/// fraction of distinct values in all blocks.
+	std::pair<double, double> sample(const fs::path& input_path, size_t n) {
+		size_t m = std::min(std::max(buffer_size / sample_count, (size_t)64), n);
+		if (m < 2)
+			return {0.0, 1.0};
+		std::ifstream fin(input_path, std::ios_base::binary);
+		std::vector<value_type> all(m * sample_count);
+		double sum = 0.0;
+		for (size_t i = 0; i < sample_count; i++) {
+			auto block = all.data() + m * i;
+			fin.seekg((n - m) / (sample_count - 1) * i * value_size, std::ios_base::beg);
+			fin.read(reinterpret_cast<char*>(block), m * value_size);
+			size_t asc = 0, desc = 0;
+			for (size_t j = 1; j < m; j++) {
+				asc += !(block[j] < block[j - 1]);
+				desc += !(block[j - 1] < block[j]);
+			}
+			sum += static_cast<double>(std::max(asc, desc)) / (m - 1);
+		}
+		// Blocks may overlap in a small input, which only makes values look more duplicated.
+		std::sort(all.begin(), all.end());
+		size_t distinct = 1;
+		for (size_t i = 1; i < all.size(); i++)
+			distinct += all[i - 1] < all[i];
+		return {sum / sample_count, static_cast<double>(distinct) / all.size()};
+	}
+
+	/// @brief Read the whole input, sort it by `std::sort`, and write it.
+	void sort_in_memory(const fs::path& input_path, const fs::path& output_path) {
+		std::vector<value_type> a(fs::file_size(input_path) / value_size);
+		std::ifstream(input_path, std::ios_base::binary)
+			.read(reinterpret_cast<char*>(a.data()), a.size() * value_size);
+		std::sort(a.begin(), a.end());
+		std::ofstream(output_path, std::ios_base::binary | std::ios_base::trunc)
+			.write(reinterpret_cast<const char*>(a.data()), a.size() * value_size);
+	}
+
+	/// @brief Memory budget in bytes.
+	size_t budget;
+	/// @brief Strategy of the last sort.
+	sort_strategy m_strategy = sort_strategy::multiway;
+};
+
+/// @brief Sort a file by the algorithm chosen from a sample of it, see `auto_sorter`.
+/// @tparam T Value type.
+/// @param input_path Path of input file.
+/// @param output_path Path of output file.
+/// @param budget Memory budget in bytes.
+/// @return The strategy chosen.
+template <class T>
+sort_strategy external_sort(const fs::path& input_path, const fs::path& output_path,
+							size_t budget) {
+	auto_sorter<T> sorter(budget);
+	sorter(input_path, output_path);
+	return sorter.strategy();
+}
+
+} // namespace qy
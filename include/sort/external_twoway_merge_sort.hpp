@@ -1,43 +1,73 @@
 #pragma once
 #include "./base_sorter.hpp"
-#include "./replacement_selection.hpp"
+#include "./merge_planner.hpp"
+#include "./merge_word.hpp"
+#include "./output_mode.hpp"
+#include "./run_generator.hpp"
 #include "bufio/fbufstream_iterator.hpp"
 #include "utils/futils.hpp"
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <optional>
 #include <queue>
 
 namespace qy {
 
-/// @brief External twoway merge sort implementation.
+/// @brief External twoway merge sort implementation, generalized to k-way merges.
+/// Segments are merged in the optimal order of a k-ary Huffman tree, padded with empty dummy
+/// segments so that every merge is full. The fan-in k is chosen by `merge_planner` from the memory
+/// budget and the device model. Merges whose inputs are ready run concurrently on worker threads,
+/// each with its own buffers, sharing the memory budget.
 /// @tparam T Value type.
-template <class T>
+/// @tparam Mode Output mode, collapsing equal values in run generation and every merge, see
+/// `output_mode.hpp`. Counting keys of plain
+/// values sorts `counted_record<T>`, lifted from the input as runs are formed.
+template <class T, class Mode = keep_all>
 class external_twoway_merge_sorter : public base_sorter {
 public:
-	using value_type = T;
+	using value_type = mode_value_t<T, Mode>;
+	using input_type = T;
 
 private:
 	/// @brief File segment with offset, pos, and file index.
 	struct file_segment {
-		size_t size;  // Segment length
-		size_t pos;	  // Segment offset
-		size_t index; // File index
+		size_t size;			 // Segment length
+		size_t pos;				 // Segment offset
+		size_t index;			 // File index
+		bool descending = false; // Whether it is read backward
 
 		bool operator<(const file_segment& o) const { return size > o.size; }
 	};
 
-	/// @brief A struct with 3 buffers for merge run.
+	/// @brief A struct with k input buffers and an output buffer for merge run.
 	struct buffer_group {
-		ifbufstream<value_type, basic_buffer_tag> input_buf1;
-		ifbufstream<value_type, basic_buffer_tag> input_buf2;
+		std::vector<ifbufstream<value_type, basic_buffer_tag>> input_bufs;
 		ofbufstream<value_type, basic_buffer_tag> output_buf;
 
-		buffer_group(size_t buffer_size) :
-			input_buf1(buffer_size), input_buf2(buffer_size), output_buf(buffer_size) {}
+		buffer_group(size_t fan_in, size_t buffer_size) :
+			input_bufs(fan_in, {buffer_size}), output_buf(buffer_size) {}
+	};
+
+	/// @brief A merge step of the Huffman tree, producing the file of its index.
+	struct merge_step {
+		std::vector<file_segment> inputs; // Non-empty input segments
+		size_t parent = 0;				  // Index of the step consuming the output, or 0 if none
+		size_t pending = 0;				  // Number of inputs not produced yet
 	};
 
 public:
-	external_twoway_merge_sorter(size_t buffer_size, size_t loser_size) :
-		base_sorter(buffer_size), loser_size(loser_size) {}
+	/// @param threads Maximal number of merges run concurrently. With 1, merges run sequentially in
+	/// the order of the Huffman tree.
+	/// @param fan_in Number of segments in a merge, or 0 to choose it from the memory budget.
+	external_twoway_merge_sorter(size_t buffer_size, size_t loser_size,
+								 size_t threads = 1, size_t fan_in = 0) :
+		base_sorter(buffer_size),
+		loser_size(loser_size),
+		threads(std::max(threads, (size_t)1)),
+		fan_in(fan_in) {}
 
 	external_twoway_merge_sorter(size_t buffer_size) :
 		external_twoway_merge_sorter(buffer_size, buffer_size) {}
@@ -45,16 +75,35 @@ public:
 	void operator()(const std::filesystem::path& input_path,
 					const std::filesystem::path& output_path) {
 		this->input_path = input_path;
+		sort(input_path, output_path);
+	}
+
+	/// @brief Sort values from an input stream of unknown length, such as stdin or a pipe.
+	/// Runs are generated as data arrives, so the input needs not be staged on disk first.
+	/// @param input Input stream, read until its end.
+	/// @param output_path Path of output file.
+	void operator()(std::istream& input, const std::filesystem::path& output_path) {
+		this->input_path.clear();
+		sort(input, output_path);
+	}
+
+	/// @brief Plan merges by a given device model, instead of measuring the device of the output.
+	void set_device(const device_model& model) { device = model; }
+
+private:
+	/// @brief Generate runs from the input, then merge them.
+	/// @param input Path of input file, or an input stream.
+	template <class Input>
+	void sort(Input&& input, const fs::path& output_path) {
 		this->output_path = output_path;
-		replacement_selection<value_type> repsel(buffer_size, loser_size);
-		segments = repsel(input_path, get_merge_file(0)); // Call replacement selection
+		run_generator<value_type, Mode, input_type> rungen(buffer_size, loser_size);
+		segments = rungen(input, get_merge_file(0)); // Generate initial segments
 #ifdef LOGGING
-		m_log["repsel"] = repsel.get_log();
+		m_log["runs"] = rungen.get_log();
 #endif
 		merge();
 	}
 
-private:
 	/// @brief Get the temporary merge file path by index.
 	/// @param id File index.
 	/// @return Path of merge file.
@@ -64,77 +113,240 @@ private:
 
 	/// @brief Merge segments.
 	void merge() {
-		// Get merge order.
+		size_t n = segments.size();
+		// Concurrent merges share the limit of open files.
+		auto clamp_fan_in = [&](size_t k, size_t workers) {
+			size_t max_fan_in = std::max(max_open_files() / workers, (size_t)2);
+			return std::clamp(k, (size_t)2, std::max(std::min(n, max_fan_in), (size_t)2));
+		};
+		size_t k = clamp_fan_in(fan_in, threads), workers = workers_for(n, k);
+		auto start = std::chrono::steady_clock::now();
+		merge_plan plan;
+		if (fan_in == 0) {
+			const device_model& model =
+				device ? *device : device_model::measured(output_path.parent_path());
+			size_t total = 0;
+			for (auto&& s : segments)
+				total += s.size;
+			// Plan for the workers the plan keeps busy, each with three buffers as a twoway merge
+			// uses. Fewer workers have a larger budget each, hence fewer merges, so it settles.
+			for (size_t w = threads;; w = workers) {
+				merge_planner planner(model, buffer_size * 3 / w, sizeof(value_type));
+				plan = planner.plan(n, total, SIZE_MAX, clamp_fan_in(SIZE_MAX, w));
+				k = clamp_fan_in(plan.passes() > 0 ? plan.fan_in.front() : 2, w);
+				workers = workers_for(n, k);
+				if (workers >= w)
+					break;
+			}
+		}
+		// Get merge order. Dummy segments make (n - 1) divisible by (k - 1).
 		std::priority_queue<file_segment> ordseg;
-		for (size_t sum = 0; size_t s : segments) {
-			ordseg.push({s, sum, 0});
-			sum += s;
+		for (size_t sum = 0; auto&& s : segments) {
+			ordseg.push({s.size, sum, 0, s.descending});
+			sum += s.size;
+		}
+		for (size_t d = n > 1 ? (k - 1 - (n - 1) % (k - 1)) % (k - 1) : 0; d > 0; d--)
+			ordseg.push({0, 0, 0});
+		// Build the Huffman tree. Step i merges k segments into file i.
+		std::vector<merge_step> steps(1);
+		while (ordseg.size() > 1) {
+			size_t i = steps.size();
+			merge_step step;
+			size_t size = 0;
+			for (size_t j = 0; j < k; j++) {
+				file_segment s = ordseg.top();
+				ordseg.pop();
+				if (s.size == 0)
+					continue; // Skip dummy segments
+				size += s.size;
+				if (s.index != 0) {
+					steps[s.index].parent = i;
+					step.pending++;
+				}
+				step.inputs.push_back(s);
+			}
+			ordseg.push({size, 0, i});
+			steps.push_back(std::move(step));
 		}
 		// Start merge.
-		buffer_group bufs(buffer_size);
-		std::vector<std::pair<file_segment, file_segment>> merge_seq;
-		size_t n = ordseg.size();
-		for (size_t i = 1; i < n; i++) {
-			file_segment s1 = ordseg.top();
-			ordseg.pop();
-			file_segment s2 = ordseg.top();
-			ordseg.pop();
-			ordseg.push({s1.size + s2.size, 0, i});
-			merge_run(bufs, i, s1, s2);
-			merge_seq.push_back({s1, s2});
-			// Remove used files.
-			if (s1.index != 0)
-				fs::remove(get_merge_file(s1.index));
-			if (s2.index != 0)
-				fs::remove(get_merge_file(s2.index));
+		size_t block = std::max(buffer_size * 3 / workers / (k + 1), (size_t)16);
+		if (workers == 1) {
+			buffer_group bufs(k, block);
+			for (size_t i = 1; i < steps.size(); i++)
+				run_step(bufs, steps, i);
+#ifdef LOGGING
+			m_log["in1"] = bufs.input_bufs[0].get_log();
+			m_log["in2"] = bufs.input_bufs[1].get_log();
+			m_log["out"] = bufs.output_buf.get_log();
+#endif
+		} else {
+			merge_parallel(steps, workers, k, block);
 		}
 		// Finalize.
-		if (n > 1)
-			fs::remove(get_merge_file(0));				// Remove the initial merge file.
-		fs::rename(get_merge_file(n - 1), output_path); // Rename the last file to output file.
-		best_merge_sequence = std::move(merge_seq);
+		if (steps.size() > 1)
+			fs::remove(get_merge_file(0)); // Remove the initial merge file.
+		fs::rename(get_merge_file(steps.size() - 1),
+				   output_path); // Rename the last file to output file.
+		best_merge_sequence.clear();
+		for (size_t i = 1; i < steps.size(); i++)
+			best_merge_sequence.push_back(steps[i].inputs);
 #ifdef LOGGING
-		m_log["in1"] = bufs.input_buf1.get_log();
-		m_log["in2"] = bufs.input_buf2.get_log();
-		m_log["out"] = bufs.output_buf.get_log();
+		m_log["threads"] = workers;
+		m_log["fan_in"] = k;
+		if (fan_in == 0) {
+			m_log["plan"] = plan.to_json();
+			m_log["plan"]["actual"] =
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
 		for (size_t i = 0; i < best_merge_sequence.size(); i++) {
-			auto&& p = best_merge_sequence[i];
 			unsigned ii = static_cast<unsigned>(i);
-			m_log["best_merge_sequence"][ii]["first"]["size"] = p.first.size;
-			m_log["best_merge_sequence"][ii]["first"]["pos"] = p.first.pos;
-			m_log["best_merge_sequence"][ii]["first"]["index"] = p.first.index;
-			m_log["best_merge_sequence"][ii]["second"]["size"] = p.second.size;
-			m_log["best_merge_sequence"][ii]["second"]["pos"] = p.second.pos;
-			m_log["best_merge_sequence"][ii]["second"]["index"] = p.second.index;
+			for (auto&& s : best_merge_sequence[i]) {
+				m_log["best_merge_sequence"][ii].push_back(
+					{{"size", s.size}, {"pos", s.pos}, {"index", s.index}});
+			}
 		}
 #endif
 	}
 
-	/// @brief Merge file segments.
-	void merge_run(buffer_group& b, size_t i, const file_segment& s1, const file_segment& s2) {
-		b.input_buf1.open(get_merge_file(s1.index));
-		b.input_buf2.open(get_merge_file(s2.index));
+	/// @brief Number of workers for merges of `n` segments by fan-in `k`, as many as the Huffman
+	/// tree keeps busy.
+	size_t workers_for(size_t n, size_t k) const {
+		size_t merges = n > 1 ? (n - 2) / (k - 1) + 1 : 0;
+		return std::max(std::min(threads, (merges + 1) / 2), (size_t)1);
+	}
+
+	/// @brief Run merge steps on worker threads, as soon as their inputs are produced.
+	/// Each worker has its own buffers, so that the memory budget is split among workers.
+	void merge_parallel(std::vector<merge_step>& steps, size_t workers, size_t k, size_t block) {
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::deque<size_t> ready; // Steps with all inputs produced
+		size_t done = 0, total = steps.size() - 1;
+		for (size_t i = 1; i < steps.size(); i++) {
+			if (steps[i].pending == 0)
+				ready.push_back(i);
+		}
+		auto worker = [&]() {
+			buffer_group bufs(k, block);
+			while (true) {
+				std::unique_lock lock(mtx);
+				cv.wait(lock, [&]() { return !ready.empty() || done == total; });
+				if (ready.empty())
+					return;
+				size_t i = ready.front();
+				ready.pop_front();
+				lock.unlock();
+				run_step(bufs, steps, i);
+				lock.lock();
+				done++;
+				size_t p = steps[i].parent;
+				if (p != 0 && --steps[p].pending == 0)
+					ready.push_back(p);
+				cv.notify_all();
+			}
+		};
+		std::vector<std::future<void>> futures;
+		for (size_t i = 0; i < workers; i++)
+			futures.push_back(std::async(std::launch::async, worker));
+		for (auto&& f : futures)
+			f.get();
+	}
+
+	/// @brief Run a merge step, and remove its input files.
+	/// The input of the parent step takes the size written, as equal values may be collapsed.
+	void run_step(buffer_group& b, std::vector<merge_step>& steps, size_t i) {
+		auto&& inputs = steps[i].inputs;
+		size_t written;
+		if (inputs.size() == 2 && !collapses<Mode>)
+			written = merge_run(b, i, inputs[0], inputs[1]);
+		else
+			written = merge_run(b, i, inputs);
+		if (size_t p = steps[i].parent; p != 0) {
+			for (auto&& s : steps[p].inputs) {
+				if (s.index == i)
+					s.size = written;
+			}
+		}
+		// Remove used files.
+		for (auto&& s : inputs) {
+			if (s.index != 0)
+				fs::remove(get_merge_file(s.index));
+		}
+	}
+
+	/// @brief Merge two file segments.
+	/// @return Number of elements written.
+	size_t merge_run(buffer_group& b, size_t i, const file_segment& s1, const file_segment& s2) {
+		auto &in1 = b.input_bufs[0], &in2 = b.input_bufs[1];
+		in1.open(get_merge_file(s1.index));
+		in2.open(get_merge_file(s2.index));
 		b.output_buf.open(get_merge_file(i));
-		b.input_buf1.seek(s1.pos, s1.pos + s1.size);
-		b.input_buf2.seek(s2.pos, s2.pos + s2.size);
-		std::merge(ifbufstream_iterator(b.input_buf1), ifbufstream_iterator<value_type>(),
-				   ifbufstream_iterator(b.input_buf2), ifbufstream_iterator<value_type>(),
+		in1.set_backward(s1.descending);
+		in2.set_backward(s2.descending);
+		in1.seek(s1.pos, s1.pos + s1.size);
+		in2.seek(s2.pos, s2.pos + s2.size);
+		std::merge(ifbufstream_iterator(in1), ifbufstream_iterator<value_type>(),
+				   ifbufstream_iterator(in2), ifbufstream_iterator<value_type>(),
 				   ofbufstream_iterator(b.output_buf));
-		b.input_buf1.close();
-		b.input_buf2.close();
+		in1.close();
+		in2.close();
+		b.output_buf.close();
+		return s1.size + s2.size;
+	}
+
+	/// @brief Merge file segments by a loser tree.
+	/// @return Number of elements written.
+	size_t merge_run(buffer_group& b, size_t i, const std::vector<file_segment>& inputs) {
+		using word = merge_word<value_type>;
+		size_t total = 0;
+		std::vector<typename word::word_type> heads;
+		for (size_t j = 0; j < inputs.size(); j++) {
+			auto&& s = inputs[j];
+			auto& in = b.input_bufs[j];
+			in.open(get_merge_file(s.index));
+			in.set_backward(s.descending);
+			in.seek(s.pos, s.pos + s.size);
+			heads.push_back(word::make(in.get(), j));
+			total += s.size;
+		}
+		b.output_buf.open(get_merge_file(i));
+		reducing_writer<value_type, Mode, ofbufstream<value_type, basic_buffer_tag>> out(b.output_buf);
+		loser_tree<typename word::word_type> lt(std::move(heads));
+		for (; total > 0; total--) {
+			size_t j = lt.top_index();
+			out << word::value(lt.top());
+			auto& in = b.input_bufs[j];
+			if (in) {
+				value_type x;
+				in >> x;
+				lt.push(word::make(x, j));
+			} else {
+				lt.push(word::exhausted(j));
+			}
+		}
+		size_t written = out.flush();
+		for (size_t j = 0; j < inputs.size(); j++)
+			b.input_bufs[j].close();
 		b.output_buf.close();
+		return written;
 	}
 
 private:
 	size_t loser_size;
-	/// @brief Path of input file.
+	/// @brief Number of merges run concurrently.
+	size_t threads;
+	/// @brief Number of segments in a merge, or 0 to choose it from the memory budget.
+	size_t fan_in;
+	/// @brief Device model to plan merges by, or none to measure it.
+	std::optional<device_model> device;
+	/// @brief Path of input file, empty if read from a stream.
 	fs::path input_path;
 	/// @brief Path of output file.
 	fs::path output_path;
-	/// @brief Length of segments to be merged.
-	std::vector<size_t> segments;
+	/// @brief Segments to be merged.
+	std::vector<run_segment> segments;
 	/// @brief The best merge sequence.
-	std::vector<std::pair<file_segment, file_segment>> best_merge_sequence;
+	std::vector<std::vector<file_segment>> best_merge_sequence;
 };
 
 } // namespace qy
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include <compare>
+#include <functional>
+#include <type_traits>
+
+namespace qy {
+
+/// @brief A record compared by its projected key.
+/// It has exactly the layout of the record, so a file of records can be sorted as a file of
+/// `keyed_record` by any sorter.
+/// @tparam R Record type.
+/// @tparam Proj Key projection, such as a pointer to data member.
+/// @tparam Compare Comparator of keys.
+template <class R, auto Proj = std::identity{}, class Compare = std::less<>>
+struct keyed_record {
+	static_assert(std::is_trivially_copyable_v<R>, "Record must be trivially copyable.");
+
+	using record_type = R;
+	using key_type = std::remove_cvref_t<std::invoke_result_t<decltype(Proj), const R&>>;
+
+	R value;
+
+	/// @brief Get the key of this record.
+	inline key_type key() const { return std::invoke(Proj, value); }
+
+	inline friend std::weak_ordering operator<=>(const keyed_record& lhs, const keyed_record& rhs) {
+		Compare comp;
+		if (comp(lhs.key(), rhs.key()))
+			return std::weak_ordering::less;
+		if (comp(rhs.key(), lhs.key()))
+			return std::weak_ordering::greater;
+		return std::weak_ordering::equivalent;
+	}
+
+	/// @brief Records are equal if their keys are equivalent.
+	inline friend bool operator==(const keyed_record& lhs, const keyed_record& rhs) {
+		return std::is_eq(lhs <=> rhs);
+	}
+};
+
+} // namespace qy
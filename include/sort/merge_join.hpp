@@ -0,0 +1,287 @@
+#pragma once
+#include "./external_multiway_merge_sort.hpp"
+#include "./merge_word.hpp"
+#include "ds/loser_tree.hpp"
+#include <span>
+#include <string>
+
+namespace qy {
+
+/// @brief Key of a value to join by, the key of a keyed record or the value itself.
+template <class T>
+inline decltype(auto) join_key(const T& x) {
+	if constexpr (requires { x.key(); })
+		return x.key();
+	else
+		return (x);
+}
+
+/// @brief Check whether a file is sorted, by one sequential pass.
+template <class T>
+bool is_sorted_file(const fs::path& path, size_t buffer_size) {
+	ifbufstream<T, double_buffer_tag> input_buf(buffer_size, path);
+	input_buf.seek(0);
+	if (!input_buf)
+		return true;
+	T prev = input_buf.get();
+	while (input_buf) {
+		T x = input_buf.get();
+		if (x < prev)
+			return false;
+		prev = x;
+	}
+	return true;
+}
+
+/// @brief Base of operators merging sorted files, which sorts inputs that are not sorted yet.
+class merge_operator : public base_sorter {
+public:
+	/// @param check_sorted Whether to check inputs and sort them if needed, or assume they are
+	/// sorted.
+	merge_operator(size_t buffer_size, bool check_sorted = true) :
+		base_sorter(buffer_size), check_sorted(check_sorted) {}
+
+protected:
+	/// @brief Get a sorted version of an input, sorting it into a temporary file if it is not.
+	/// @tparam T Value type.
+	/// @tparam Sorter Sorter of the input.
+	/// @param path Path of the input.
+	/// @param output_path Path of output file, next to which temporary files are written.
+	/// @param i Index of the input.
+	/// @return Path of the sorted input.
+	template <class T, class Sorter>
+	fs::path sorted_input(const fs::path& path, const fs::path& output_path, size_t i) {
+		if (!check_sorted || is_sorted_file<T>(path, buffer_size))
+			return path;
+		auto sorted_path = output_path;
+		sorted_path.replace_filename(".sorted_" + std::to_string(i));
+		Sorter sorter(buffer_size);
+		sorter(path, sorted_path);
+		temporaries.push_back(sorted_path);
+#ifdef LOGGING
+		m_log["sorted"].push_back(i);
+#endif
+		return sorted_path;
+	}
+
+	/// @brief Remove temporary files of sorted inputs.
+	void remove_temporaries() {
+		for (auto&& p : temporaries)
+			fs::remove(p);
+		temporaries.clear();
+	}
+
+	/// @brief Whether to check inputs and sort them if needed.
+	bool check_sorted;
+	/// @brief Temporary files of sorted inputs.
+	std::vector<fs::path> temporaries;
+};
+
+/// @brief Kinds of joins.
+enum class join_kind {
+	inner, // Pairs of matching records
+	left,  // Pairs of matching records, and left records without match paired with none
+	semi,  // Left records with any match
+	anti   // Left records without match
+};
+
+/// @brief A pair of joined records.
+template <class L, class R>
+struct joined {
+	L left;
+	R right;
+	/// @brief Whether the right record is matched, false for a left record without match.
+	bool matched = true;
+};
+
+/// @brief Sort-merge join of two files by key.
+/// Both sides are streamed in key order. Only the right records of the current key are held, to
+/// pair them with each left record of the key, and they are read again from the file if they
+/// exceed the buffer. Unsorted inputs are sorted first.
+/// @tparam L Left record type.
+/// @tparam R Right record type. Keys of both sides should be comparable, see `join_key`.
+/// @tparam Kind Kind of join. Inner and left joins output `joined` pairs, others left records.
+/// @tparam SorterL Sorter of the left input.
+/// @tparam SorterR Sorter of the right input.
+template <class L, class R, join_kind Kind = join_kind::inner,
+		  class SorterL = external_multiway_merge_sorter<L>,
+		  class SorterR = external_multiway_merge_sorter<R>>
+class merge_joiner : public merge_operator {
+public:
+	using output_type =
+		std::conditional_t<Kind == join_kind::inner || Kind == join_kind::left, joined<L, R>, L>;
+
+	using merge_operator::merge_operator;
+
+	void operator()(const fs::path& left_path, const fs::path& right_path,
+					const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["sorted"] = json::array();
+		m_log["reread_groups"] = 0;
+#endif
+		auto lpath = sorted_input<L, SorterL>(left_path, output_path, 0);
+		auto rpath = sorted_input<R, SorterR>(right_path, output_path, 1);
+		// Buffers of both sides, the output, and the group read again.
+		size_t block = std::max(buffer_size / 4, (size_t)16);
+		ifbufstream<L, double_buffer_tag> left_buf(block, lpath);
+		ifbufstream<R, double_buffer_tag> right_buf(block, rpath);
+		// The group is read again by seeking back each time, so without read-ahead.
+		ifbufstream<R, basic_buffer_tag> group_buf(block, rpath);
+		ofbufstream<output_type, double_buffer_tag> output_buf(block, output_path);
+		left_buf.seek(0);
+		right_buf.seek(0);
+		auto less = [](const auto& a, const auto& b) { return join_key(a) < join_key(b); };
+
+		std::vector<R> group;	// Right records of the current key, if they fit in memory
+		R head{};				// First right record of the current key
+		bool has_group = false; // Whether a group is held
+		size_t group_first = 0, group_size = 0, rpos = 0;
+		bool has_right = right_buf;
+		R r = has_right ? right_buf.get() : R{};
+		auto next_right = [&]() {
+			rpos++;
+			has_right = right_buf;
+			if (has_right)
+				r = right_buf.get();
+		};
+		size_t reread = 0, written = 0;
+		while (left_buf) {
+			L l = left_buf.get();
+			// Take the group of right records of the key of this record, if it has not been taken.
+			if (!has_group || less(head, l)) {
+				has_group = false;
+				group.clear();
+				while (has_right && less(r, l))
+					next_right();
+				if (has_right && !less(l, r)) {
+					head = r;
+					group_first = rpos;
+					for (group_size = 0; has_right && !less(head, r); group_size++) {
+						if (group.size() < buffer_size)
+							group.push_back(r);
+						next_right();
+					}
+					has_group = true;
+				}
+			}
+			bool matched = has_group && !less(l, head);
+			if constexpr (Kind == join_kind::semi || Kind == join_kind::anti) {
+				if (matched == (Kind == join_kind::semi)) {
+					output_buf << l;
+					written++;
+				}
+			} else if (!matched) {
+				if constexpr (Kind == join_kind::left) {
+					output_buf << output_type{l, R{}, false};
+					written++;
+				}
+			} else if (group.size() == group_size) {
+				for (auto&& x : group)
+					output_buf << output_type{l, x, true};
+				written += group_size;
+			} else {
+				// The group exceeds the buffer. Read it again from the file.
+				group_buf.seek(group_first, group_first + group_size);
+				while (group_buf)
+					output_buf << output_type{l, group_buf.get(), true};
+				written += group_size;
+				reread++;
+			}
+		}
+		left_buf.close();
+		right_buf.close();
+		group_buf.close();
+		output_buf.close();
+		remove_temporaries();
+#ifdef LOGGING
+		m_log["reread_groups"] = reread;
+		m_log["output"] = written;
+#endif
+	}
+};
+
+/// @brief Kinds of set operations.
+enum class set_kind {
+	intersect, // Values in all inputs
+	subtract,  // Values in the first input but not in others
+	unite	   // Values in any input
+};
+
+/// @brief Set operation of two or more files by merging them.
+/// All inputs are merged by a loser tree, and each group of equal values is output at most once
+/// according to the inputs it comes from, as SQL INTERSECT, EXCEPT and UNION do. The value of the
+/// earliest input is output among equal ones. Unsorted inputs are sorted first.
+/// @tparam T Value type.
+/// @tparam Kind Kind of set operation.
+/// @tparam Sorter Sorter of inputs.
+template <class T, set_kind Kind, class Sorter = external_multiway_merge_sorter<T>>
+class merge_set_operator : public merge_operator {
+public:
+	using value_type = T;
+	/// @brief Loser tree word, packing the input index to break ties by order of inputs.
+	using word = merge_word<value_type, false>;
+
+	using merge_operator::merge_operator;
+
+	void operator()(std::span<const fs::path> input_paths, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["sorted"] = json::array();
+#endif
+		size_t k = input_paths.size();
+		size_t block = std::max(buffer_size / (k + 1), (size_t)16);
+		std::vector<ifbufstream<value_type, double_buffer_tag>> inputs(k, {block});
+		std::vector<typename word::word_type> heads(k);
+		size_t total = 0;
+		for (size_t i = 0; i < k; i++) {
+			inputs[i].open(sorted_input<value_type, Sorter>(input_paths[i], output_path, i));
+			inputs[i].seek(0);
+			total += inputs[i].size();
+			heads[i] = inputs[i] ? word::make(inputs[i].get(), i) : word::exhausted(i);
+		}
+		loser_tree<typename word::word_type> lt(std::move(heads));
+		ofbufstream<value_type, double_buffer_tag> output_buf(block, output_path);
+		// Pop the top value, and replace it by the next of its input.
+		auto pop = [&]() {
+			size_t i = lt.top_index();
+			value_type x = word::value(lt.top());
+			lt.push(inputs[i] ? word::make(inputs[i].get(), i) : word::exhausted(i));
+			total--;
+			return std::pair{x, i};
+		};
+		std::vector<bool> seen(k);
+		size_t written = 0;
+		while (total > 0) {
+			auto [x, i] = pop();
+			std::fill(seen.begin(), seen.end(), false);
+			seen[i] = true;
+			size_t count = 1; // Number of inputs holding the value
+			while (total > 0 && !(x < word::value(lt.top()))) {
+				size_t j = pop().second;
+				count += !seen[j];
+				seen[j] = true;
+			}
+			bool keep;
+			if constexpr (Kind == set_kind::intersect)
+				keep = count == k;
+			else if constexpr (Kind == set_kind::subtract)
+				keep = seen[0] && count == 1;
+			else
+				keep = true;
+			if (keep) {
+				output_buf << x;
+				written++;
+			}
+		}
+		output_buf.close();
+		for (auto&& input : inputs)
+			input.close();
+		remove_temporaries();
+#ifdef LOGGING
+		m_log["output"] = written;
+#endif
+	}
+};
+
+} // namespace qy
@@ -0,0 +1,245 @@
+#pragma once
+#include "utils/json_log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace qy {
+
+namespace fs = std::filesystem;
+
+/// @brief I/O cost model of a storage device.
+struct device_model {
+	double seek_latency; // Seconds per random access
+	double bandwidth;	 // Bytes per second of sequential transfer
+
+	/// @brief Predicted time to transfer some bytes in some random accesses.
+	double cost(double bytes, double accesses) const {
+		return accesses * seek_latency + bytes / bandwidth;
+	}
+
+	/// @brief Measure the device of a directory by a short calibration run.
+	/// A temporary file is written and read sequentially for bandwidth, then read in small blocks at
+	/// random offsets for the latency left after transfer. The file is synced and dropped from the
+	/// page cache before each read, so that the device is measured instead of memory.
+	/// @param dir Directory on the device.
+	/// @param file_bytes Size of the temporary file.
+	/// @param probes Number of random reads.
+	static device_model calibrate(const fs::path& dir, size_t file_bytes = 16 << 20,
+								  size_t probes = 256) {
+		using clock = std::chrono::steady_clock;
+		constexpr size_t chunk = 1 << 20, probe_bytes = 4096;
+		auto path = (dir.empty() ? fs::path(".") : dir) / ".calibrate";
+		std::vector<char> buf(chunk);
+		std::mt19937_64 rng(0);
+		std::ranges::generate(buf, rng);
+		{
+			std::ofstream fout(path, std::ios_base::binary | std::ios_base::trunc);
+			for (size_t i = 0; i < file_bytes; i += chunk)
+				fout.write(buf.data(), chunk);
+		}
+		device_model m{};
+		drop_cache(path);
+		std::ifstream fin(path, std::ios_base::binary);
+		auto t0 = clock::now();
+		for (size_t i = 0; i < file_bytes; i += chunk)
+			fin.read(buf.data(), chunk);
+		auto t1 = clock::now();
+		m.bandwidth = file_bytes / std::max(std::chrono::duration<double>(t1 - t0).count(), 1e-9);
+		fin.clear();
+		drop_cache(path);
+		t1 = clock::now();
+		for (size_t i = 0; i < probes; i++) {
+			fin.seekg(rng() % (file_bytes - probe_bytes) / probe_bytes * probe_bytes);
+			fin.read(buf.data(), probe_bytes);
+		}
+		auto t2 = clock::now();
+		double t = std::chrono::duration<double>(t2 - t1).count() - probes * probe_bytes / m.bandwidth;
+		m.seek_latency = std::max(t / probes, 1e-7);
+		fin.close();
+		fs::remove(path);
+		return m;
+	}
+
+	/// @brief Get the model of the device of a directory, calibrated at the first call for the
+	/// device in the process, unless it is assumed.
+	/// @param dir Directory on the device.
+	static const device_model& measured(const fs::path& dir) {
+		std::lock_guard lock(registry_mutex());
+		auto& models = registry();
+		auto key = device_of(dir);
+		auto it = models.find(key);
+		if (it == models.end())
+			it = models.emplace(key, calibrate(dir)).first;
+		return it->second;
+	}
+
+	/// @brief Assume the model of the device of a directory instead of calibrating it, so that
+	/// plans are deterministic and no calibration is timed with the first sort.
+	/// @param dir Directory on the device.
+	/// @param model Model of the device.
+	static void assume(const fs::path& dir, const device_model& model) {
+		std::lock_guard lock(registry_mutex());
+		registry().insert_or_assign(device_of(dir), model);
+	}
+
+private:
+	/// @brief Models of devices by their identifiers.
+	static std::map<std::string, device_model>& registry() {
+		static std::map<std::string, device_model> models;
+		return models;
+	}
+
+	static std::mutex& registry_mutex() {
+		static std::mutex mtx;
+		return mtx;
+	}
+
+	/// @brief Identifier of the device of a directory.
+	static std::string device_of(const fs::path& dir) {
+		auto d = dir.empty() ? fs::path(".") : dir;
+#ifndef _WIN32
+		struct stat st;
+		if (::stat(d.c_str(), &st) == 0)
+			return std::to_string(st.st_dev);
+#endif
+		return fs::absolute(d).root_name().string();
+	}
+
+	/// @brief Write back a file, and drop it from the page cache.
+	static void drop_cache([[maybe_unused]] const fs::path& path) {
+#ifndef _WIN32
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		::fsync(fd);
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+#endif
+	}
+};
+
+/// @brief Maximal number of files a merge may open at once.
+/// Each run of a merge is read by its own stream, so fan-in is bounded by the soft limit of open
+/// files of the process, leaving some for outputs and other streams.
+inline size_t max_open_files() {
+	constexpr size_t reserved = 64;
+#ifndef _WIN32
+	rlimit rl;
+	if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+		size_t limit = rl.rlim_cur;
+		return limit > 2 * reserved ? limit - reserved : limit / 2;
+	}
+#endif
+	// Default limit of stdio streams of the MSVC runtime.
+	return 512 - reserved;
+}
+
+/// @brief Plan of a multi-pass merge.
+struct merge_plan {
+	std::vector<size_t> fan_in; // Fan-in of each pass
+	std::vector<size_t> block;	// Buffer size of each run in each pass, in number of elements
+	double predicted = 0.0;		// Predicted time in seconds
+
+	size_t passes() const { return fan_in.size(); }
+
+#ifdef LOGGING
+	json to_json() const {
+		return {{"passes", passes()}, {"fan_in", fan_in}, {"block", block}, {"predicted", predicted}};
+	}
+#endif
+};
+
+/// @brief Planner of merges by an I/O cost model.
+/// Each pass reads and writes all data, and each block read or written costs a random access, as
+/// runs are interleaved. More passes allow smaller fan-in and larger blocks, so the planner
+/// minimises the predicted time over the number of passes, with balanced fan-in.
+class merge_planner {
+public:
+	/// @brief Minimal buffer size of a run, in number of elements.
+	constexpr static size_t min_block = 16;
+
+	/// @param device Device model.
+	/// @param budget Memory budget of a merge, in number of elements.
+	/// @param value_size Size of an element in bytes.
+	merge_planner(const device_model& device, size_t budget, size_t value_size) :
+		device(device), budget(budget), value_size(value_size) {}
+
+	/// @brief Plan the merge of some runs.
+	/// @param runs Number of runs.
+	/// @param n Total number of elements.
+	/// @param max_passes Maximal number of passes.
+	/// @param max_fan_in Maximal fan-in of a pass. Plans exceeding it are taken only if no other
+	/// plan is allowed within `max_passes`.
+	merge_plan plan(size_t runs, size_t n, size_t max_passes = SIZE_MAX,
+					size_t max_fan_in = SIZE_MAX) const {
+		merge_plan best;
+		if (runs <= 1)
+			return best;
+		best.predicted = INFINITY;
+		bool best_bounded = false;
+		for (size_t p = 1; p <= max_passes; p++) {
+			merge_plan cur;
+			// Balance fan-in among passes left.
+			for (size_t r = runs, left = p; r > 1; left--) {
+				size_t f = min_fan_in(r, left);
+				cur.fan_in.push_back(f);
+				cur.block.push_back(std::max(budget / (f + 1), min_block));
+				cur.predicted += pass_cost(n, cur.block.back());
+				r = (r + f - 1) / f;
+			}
+			bool bounded = std::ranges::max(cur.fan_in) <= max_fan_in;
+			if (bounded && !best_bounded)
+				best.predicted = INFINITY;
+			if ((bounded || !best_bounded) && cur.predicted < best.predicted) {
+				best = std::move(cur);
+				best_bounded = bounded;
+			}
+			if (min_fan_in(runs, p) == 2)
+				break;
+		}
+		return best;
+	}
+
+	/// @brief Predicted time of a pass over `n` elements with the buffer size of each run.
+	double pass_cost(size_t n, size_t block) const {
+		double blocks = std::ceil((double)n / block);
+		return device.cost(2.0 * n * value_size, 2.0 * blocks);
+	}
+
+private:
+	/// @brief Least fan-in to merge all runs in `p` passes.
+	static size_t min_fan_in(size_t runs, size_t p) {
+		size_t k = std::max((size_t)std::floor(std::pow((double)runs, 1.0 / p)), (size_t)2);
+		while (power_less(k, p, runs))
+			k++;
+		return k;
+	}
+
+	/// @brief Whether k^p < runs, without overflow.
+	static bool power_less(size_t k, size_t p, size_t runs) {
+		size_t x = 1;
+		for (size_t i = 0; i < p && x < runs; i++)
+			x *= k;
+		return x < runs;
+	}
+
+	device_model device;
+	size_t budget;
+	size_t value_size;
+};
+
+} // namespace qy
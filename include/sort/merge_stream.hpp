@@ -0,0 +1,152 @@
+#pragma once
+#include "./merge_word.hpp"
+#include "./output_mode.hpp"
+#include "./replacement_selection.hpp"
+#include "bufio/fbufstream_iterator.hpp"
+#include "bufio/pooled_ifbufsteam.hpp"
+#include "ds/inline_loser_tree.hpp"
+#include <span>
+
+namespace qy {
+
+/// @brief Pull-based stream of a merge of sorted segments of a file.
+/// It holds the loser tree and the buffer pool of a merge, and selects the next value only when it
+/// is read, so that consumers iterate the sorted result without it being written to a file first.
+/// Equal values are collapsed by the output mode as they are read.
+/// The stream keeps pointers into itself for asynchronous loads, so it is neither copied nor moved.
+/// @tparam T Value type.
+/// @tparam Mode Output mode, see `output_mode.hpp`.
+template <class T, class Mode = keep_all>
+class merge_ifbufstream : public json_log {
+public:
+	using value_type = T;
+	/// @brief Loser tree word, packing the run index, as the pool requires ties broken by run.
+	using word = merge_word<value_type, false>;
+	using tree_type =
+		std::conditional_t<word::entry::is_packed, inline_loser_tree<typename word::word_type>,
+						   loser_tree<typename word::word_type>>;
+
+	/// @param path Path of the file of segments.
+	/// @param segments Consecutive segments from the beginning of the file.
+	/// @param block Buffer size of each segment.
+	/// @param temporary Whether the file is removed with the stream.
+	merge_ifbufstream(const fs::path& path, std::span<const run_segment> segments, size_t block,
+					  bool temporary = false) :
+		m_path(path),
+		m_temporary(temporary),
+		m_interval(block),
+		m_pool(segments.size(), block),
+		m_tree(open(segments)) {}
+
+	merge_ifbufstream(const merge_ifbufstream&) = delete;
+
+	~merge_ifbufstream() {
+		m_pool.close();
+		if (m_temporary)
+			fs::remove(m_path);
+	}
+
+	/// @brief Whether any value remains.
+	inline operator bool() const { return m_held || m_remaining > 0; }
+
+	inline merge_ifbufstream& operator>>(value_type& x) {
+		if constexpr (!collapses<Mode>) {
+			x = pop();
+		} else {
+			// Read ahead for values equal to this one, and hold the first different one.
+			x = m_held ? m_value : pop();
+			m_held = false;
+			while (m_remaining > 0) {
+				value_type y = pop();
+				if (!(x < y) && !(y < x)) {
+					m_mode(x, y);
+				} else {
+					m_value = y;
+					m_held = true;
+					break;
+				}
+			}
+		}
+		return *this;
+	}
+
+	/// @brief Read one value.
+	inline value_type get() {
+		value_type x;
+		*this >> x;
+		return x;
+	}
+
+	ifbufstream_iterator<value_type, merge_ifbufstream> begin() { return {*this}; }
+
+	ifbufstream_sentinel end() { return {}; }
+
+#ifdef LOGGING
+	json get_log() const {
+		auto log = m_pool.get_log();
+		log["remaining"] = m_remaining;
+		return log;
+	}
+#endif
+
+private:
+	/// @brief Open all segments in the pool.
+	/// @return Heads of all segments.
+	std::vector<typename word::word_type> open(std::span<const run_segment> segments) {
+		std::vector<typename word::word_type> heads(segments.size());
+		for (size_t sum = 0, i = 0; i < segments.size(); i++) {
+			m_pool[i].open(m_path);
+			m_pool[i].set_backward(segments[i].descending);
+			m_pool[i].seek(sum, sum + segments[i].size);
+			sum += segments[i].size;
+			m_remaining += segments[i].size;
+		}
+		m_pool.collect_allocate();
+		for (size_t i = 0; i < segments.size(); i++)
+			heads[i] = m_pool[i] ? word::make(m_pool[i].get(), i) : word::exhausted(i);
+		return heads;
+	}
+
+	/// @brief Select the minimal value of all segments, and replace it by the next of its segment.
+	inline value_type pop() {
+		// Collect & allocate buffers of the pool at intervals, as a merge does.
+		if (++m_step == m_interval) {
+			m_pool.collect_allocate();
+			m_step = 0;
+		}
+		size_t i = m_tree.top_index();
+		value_type x = word::value(m_tree.top());
+		if (m_pool[i]) {
+			value_type y;
+			m_pool[i] >> y;
+			m_tree.push(word::make(y, i));
+		} else {
+			m_tree.push(word::exhausted(i));
+		}
+		m_remaining--;
+		return x;
+	}
+
+	/// @brief Path of the file of segments.
+	fs::path m_path;
+	/// @brief Whether the file is removed with the stream.
+	bool m_temporary;
+	/// @brief Interval of values to collect & allocate buffers of the pool.
+	size_t m_interval;
+	/// @brief Number of values read since the last collection.
+	size_t m_step = 0;
+	/// @brief Number of values not selected yet.
+	size_t m_remaining = 0;
+	/// @brief Buffer pool of segments.
+	ifbufstream_pool<value_type> m_pool;
+	/// @brief Loser tree of heads of segments.
+	tree_type m_tree;
+	/// @brief Output mode.
+	Mode m_mode{};
+	/// @brief Whether a value is held, read ahead for collapsing.
+	bool m_held = false;
+	/// @brief The held value.
+	value_type m_value{};
+};
+
+} // namespace qy
@@ -0,0 +1,43 @@
+#pragma once
+#include "./normalized_key.hpp"
+#include "ds/loser_tree.hpp"
+
+namespace qy {
+
+/// @brief Words held by a merge selector for heads of runs.
+/// With a +inf sentinel, a word is the bare value, and an exhausted run holds the sentinel. Loser
+/// trees know the index of the top element by themselves. Merges stop by counting the remaining
+/// elements, so a real value equal to the sentinel is still output correctly.
+/// Otherwise, the run index is packed with the value, and a set high tag orders exhausted runs
+/// after all real ones.
+/// @tparam T Value type.
+/// @tparam Bare Whether to hold bare values.
+template <class T, bool Bare = has_sentinel<T>>
+struct merge_word {
+	using value_type = T;
+	using word_type = T;
+	constexpr static bool is_bare = true;
+
+	static word_type make(const T& x, size_t) { return x; }
+
+	static const T& value(const word_type& w) { return w; }
+
+	static word_type exhausted(size_t) { return loser_tree_traits<T>::sentinel(); }
+};
+
+template <class T>
+struct merge_word<T, false> {
+	using value_type = T;
+	/// @brief Packed entry, ordered by state, value and then run index.
+	using entry = packed_key<T, 24>;
+	using word_type = typename entry::word_type;
+	constexpr static bool is_bare = false;
+
+	static word_type make(const T& x, size_t i) { return entry::pack(0, x, i); }
+
+	static T value(const word_type& w) { return entry::value(w); }
+
+	static word_type exhausted(size_t i) { return entry::pack(1, {}, i); }
+};
+
+} // namespace qy
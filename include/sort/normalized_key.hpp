@@ -0,0 +1,154 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+namespace qy {
+
+/// @brief Order-preserving map from values to unsigned integers.
+/// `encode(x) < encode(y)` if and only if `x` is ordered before `y`.
+/// For floating-point types, the order is the IEEE total order: -NaN < -inf < ... < -0 < +0 < ...
+/// < +inf < +NaN, which agrees with `<` on all ordered, non-equal values.
+/// @tparam T Value type.
+template <class T>
+struct normalized_key;
+
+template <std::unsigned_integral T>
+struct normalized_key<T> {
+	using type = T;
+
+	static constexpr type encode(T x) { return x; }
+
+	static constexpr T decode(type k) { return k; }
+};
+
+template <std::signed_integral T>
+struct normalized_key<T> {
+	using type = std::make_unsigned_t<T>;
+	constexpr static type sign_bit = type(1) << (sizeof(type) * 8 - 1);
+
+	// Flipping the sign bit moves negative values below positive ones.
+	static constexpr type encode(T x) { return type(x) ^ sign_bit; }
+
+	static constexpr T decode(type k) { return T(k ^ sign_bit); }
+};
+
+template <std::floating_point T>
+	requires(sizeof(T) == 4 || sizeof(T) == 8)
+struct normalized_key<T> {
+	using type = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+	constexpr static int shift = sizeof(type) * 8 - 1;
+	constexpr static type sign_bit = type(1) << shift;
+
+	// Negative values have all bits flipped so that larger magnitudes come first, while
+	// non-negative values only have the sign bit set.
+	static constexpr type encode(T x) {
+		type bits = std::bit_cast<type>(x);
+		return bits ^ (type(-(bits >> shift)) | sign_bit);
+	}
+
+	static constexpr T decode(type k) { return std::bit_cast<T>(k ^ (((k >> shift) - 1) | sign_bit)); }
+};
+
+/// @brief Types with an order-preserving unsigned key.
+template <class T>
+concept normalizable = requires { typename normalized_key<T>::type; };
+
+/// @brief Get the normalized key of a value.
+template <normalizable T>
+constexpr auto normalize(T x) {
+	return normalized_key<T>::encode(x);
+}
+
+/// @brief Get the normalized key of a value as big-endian bytes, so that `memcmp` and radix
+/// passes over bytes follow the order of values.
+template <normalizable T>
+constexpr auto normalized_bytes(T x) {
+	auto k = normalize(x);
+	if constexpr (std::endian::native == std::endian::little)
+		k = std::byteswap(k);
+	return std::bit_cast<std::array<unsigned char, sizeof(k)>>(k);
+}
+
+#ifdef __SIZEOF_INT128__
+using uint128_t = unsigned __int128;
+#endif
+
+/// @brief Pack a high tag, a value and a low tag into one word, ordered lexicographically.
+/// With normalizable values, the word is a single unsigned integer, so that a comparison in the
+/// loser tree is one integer comparison. Otherwise, it falls back to a tuple.
+/// A value-initialized word is less than any packed word with nonzero high tag.
+/// @tparam T Value type.
+/// @tparam LowBits Number of bits of the low tag.
+template <class T, int LowBits = 0>
+struct packed_key {
+	using value_type = T;
+	using word_type = std::tuple<uint64_t, T, uint64_t>;
+	constexpr static bool is_packed = false;
+
+	static word_type pack(uint64_t high, const T& value, uint64_t low = 0) {
+		return {high, value, low};
+	}
+
+	static uint64_t high(const word_type& w) { return std::get<0>(w); }
+
+	static const T& value(const word_type& w) { return std::get<1>(w); }
+
+	static uint64_t low(const word_type& w) { return std::get<2>(w); }
+};
+
+/// @brief Bit width of words of `packed_key`, or zero if values cannot be packed.
+template <class T, int LowBits>
+constexpr int packed_key_width() {
+	if constexpr (!normalizable<T>)
+		return 0;
+	else if constexpr (sizeof(T) * 8 + LowBits <= 56)
+		return 64;
+#ifdef __SIZEOF_INT128__
+	else if constexpr (sizeof(T) * 8 + LowBits <= 120)
+		return 128;
+#endif
+	else
+		return 0;
+}
+
+template <class T, int LowBits>
+	requires(packed_key_width<T, LowBits>() > 0)
+struct packed_key<T, LowBits> {
+	using value_type = T;
+	using key_type = typename normalized_key<T>::type;
+#ifdef __SIZEOF_INT128__
+	using word_type = std::conditional_t<packed_key_width<T, LowBits>() == 64, uint64_t, uint128_t>;
+#else
+	using word_type = uint64_t;
+#endif
+	constexpr static bool is_packed = true;
+	constexpr static int key_bits = sizeof(key_type) * 8;
+	constexpr static int high_shift = key_bits + LowBits;
+	/// @brief Number of bits left for the high tag.
+	constexpr static int high_bits = sizeof(word_type) * 8 - high_shift;
+
+	static constexpr word_type pack(uint64_t high, T value, uint64_t low = 0) {
+		return pack_key(high, normalized_key<T>::encode(value), low);
+	}
+
+	/// @brief Pack a normalized key directly, such as a complemented one for descending order.
+	static constexpr word_type pack_key(uint64_t high, key_type key, uint64_t low = 0) {
+		return word_type(high) << high_shift | word_type(key) << LowBits | word_type(low);
+	}
+
+	static constexpr uint64_t high(word_type w) { return uint64_t(w >> high_shift); }
+
+	static constexpr T value(word_type w) { return normalized_key<T>::decode(key(w)); }
+
+	static constexpr key_type key(word_type w) { return key_type(w >> LowBits); }
+
+	static constexpr uint64_t low(word_type w) {
+		return uint64_t(w & ((word_type(1) << LowBits) - 1));
+	}
+};
+
+} // namespace qy
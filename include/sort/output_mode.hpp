@@ -0,0 +1,135 @@
+#pragma once
+#include "./keyed_record.hpp"
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace qy {
+
+/// @brief Output mode keeping all values.
+struct keep_all {};
+
+/// @brief Output mode keeping one of equal values, as `sort | uniq`.
+struct keep_unique {
+	template <class T>
+	void operator()(T&, const T&) const {}
+};
+
+/// @brief Output mode combining equal values by an operation.
+/// Equal values of different runs meet in any order, so the operation should be associative and
+/// commutative.
+/// @tparam Op Binary operation on values, default constructible.
+template <class Op>
+struct reduce_by {
+	Op op;
+
+	template <class T>
+	void operator()(T& acc, const T& x) const {
+		acc = op(acc, x);
+	}
+};
+
+/// @brief A value with its number of occurrences.
+template <class T>
+struct counted {
+	T value;
+	uint64_t count = 1;
+};
+
+/// @brief Record of `counted`, compared by value.
+template <class T>
+using counted_record = keyed_record<counted<T>, &counted<T>::value>;
+
+/// @brief Output mode summing counts of equal values, as `sort | uniq -c`.
+/// Values are `counted_record`, so that runs carry partial counts through all merge levels.
+struct count_keys {
+	template <class T>
+	void operator()(counted_record<T>& acc, const counted_record<T>& x) const {
+		acc.value.count += x.value.count;
+	}
+};
+
+/// @brief Values held by a sorter of input values `T` in an output mode, and the lift of an input
+/// value into them. Counting keys lifts a plain value into a record of one occurrence, so that a
+/// file of plain values is counted as runs are formed, without converting it first.
+template <class T, class Mode>
+struct mode_value {
+	using type = T;
+
+	const type& operator()(const T& x) const { return x; }
+};
+
+template <class T>
+struct mode_value<T, count_keys> {
+	using type = counted_record<T>;
+
+	type operator()(const T& x) const { return {{x, 1}}; }
+};
+
+template <class T>
+struct mode_value<counted_record<T>, count_keys> {
+	using type = counted_record<T>;
+
+	const type& operator()(const type& x) const { return x; }
+};
+
+template <class T, class Mode>
+using mode_value_t = typename mode_value<T, Mode>::type;
+
+/// @brief Whether an output mode collapses equal values.
+template <class Mode>
+constexpr bool collapses = !std::is_same_v<Mode, keep_all>;
+
+/// @brief Output filter collapsing adjacent equal values by an output mode.
+/// The last value is held until a different one arrives or the run ends, so that it is written
+/// once with all equal values combined.
+/// @tparam T Value type.
+/// @tparam Mode Output mode.
+/// @tparam Stream Output stream.
+template <class T, class Mode, class Stream>
+class reducing_writer {
+public:
+	reducing_writer(Stream& stream, const Mode& mode = {}) : m_stream(stream), m_mode(mode) {}
+
+	inline reducing_writer& operator<<(const T& x) {
+		if constexpr (!collapses<Mode>) {
+			m_stream << x;
+			m_count++;
+		} else if (m_held && !(m_value < x) && !(x < m_value)) {
+			m_mode(m_value, x);
+		} else {
+			if (m_held) {
+				m_stream << m_value;
+				m_count++;
+			}
+			m_value = x;
+			m_held = true;
+		}
+		return *this;
+	}
+
+	/// @brief End a run, writing the held value.
+	/// @return Number of values written in the run.
+	size_t flush() {
+		if constexpr (collapses<Mode>) {
+			if (m_held) {
+				m_stream << m_value;
+				m_count++;
+				m_held = false;
+			}
+		}
+		return std::exchange(m_count, 0);
+	}
+
+private:
+	Stream& m_stream;
+	Mode m_mode;
+	/// @brief Number of values written in the run.
+	size_t m_count = 0;
+	/// @brief Whether a value is held.
+	bool m_held = false;
+	/// @brief The held value.
+	T m_value{};
+};
+
+} // namespace qy
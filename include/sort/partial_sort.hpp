@@ -0,0 +1,104 @@
+#pragma once
+#include "./external_quick_sort.hpp"
+#include "ds/interval_heap.hpp"
+#include <algorithm>
+
+namespace qy {
+
+/// @brief External partial sort, writing the smallest or largest K values in ascending order.
+/// If K values fit in memory, the input is streamed once through a bounded `interval_heap`, whose
+/// opposite end evicts values that cannot be among the K. Otherwise, the quick sorter partitions
+/// the input, and discards partitions out of the K ranks instead of recursing into them.
+/// Thus I/O is proportional to N + K rather than N log N.
+/// @tparam T Value type.
+/// @tparam Tag Buffer tag.
+template <class T, class Tag = double_buffer_tag>
+class partial_sorter : public base_sorter {
+public:
+	using value_type = T;
+
+	/// @param k Number of values to output.
+	/// @param largest Whether to output the largest values instead of the smallest.
+	partial_sorter(size_t buffer_size, size_t k, bool largest = false) :
+		base_sorter(buffer_size), k(k), largest(largest) {}
+
+	void operator()(const fs::path& input_path, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+#endif
+		size_t n = fs::file_size(input_path) / sizeof(value_type);
+		size_t m = std::min(k, n);
+		// The heap holds as many values as the middle group of the quick sorter.
+		external_quick_sorter<value_type, Tag> sorter(buffer_size);
+		if (m <= sorter.middle_capacity()) {
+			select_in_memory(input_path, output_path, m);
+		} else {
+			// Sort only partitions of the K ranks, then drop the rest of the file.
+			size_t first = largest ? n - m : 0;
+			sorter(input_path, output_path, first, first + m);
+			if (largest) {
+				// Move the last K values to front, as the output holds only them.
+				std::fstream f(output_path,
+							   std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+				std::vector<value_type> buf(buffer_size);
+				for (size_t i = 0; i < m; i += buf.size()) {
+					size_t c = std::min(buf.size(), m - i);
+					f.seekg((first + i) * sizeof(value_type), std::ios_base::beg);
+					f.read(reinterpret_cast<char*>(buf.data()), c * sizeof(value_type));
+					f.seekp(i * sizeof(value_type), std::ios_base::beg);
+					f.write(reinterpret_cast<const char*>(buf.data()), c * sizeof(value_type));
+				}
+			}
+			fs::resize_file(output_path, m * sizeof(value_type));
+#ifdef LOGGING
+			m_log["quick"] = sorter.get_log();
+#endif
+		}
+#ifdef LOGGING
+		m_log["k"] = m;
+		m_log["in_memory"] = m <= sorter.middle_capacity();
+#endif
+	}
+
+private:
+	/// @brief Select K values by a bounded interval heap in one pass.
+	void select_in_memory(const fs::path& input_path, const fs::path& output_path, size_t m) {
+		interval_heap<value_type> heap;
+		ifbufstream<value_type, Tag> input_buf(buffer_size, input_path);
+		input_buf.seek(0);
+		size_t evicted = 0;
+		while (input_buf && heap.size() < m) {
+			value_type x;
+			input_buf >> x;
+			heap.push(x);
+		}
+		while (m > 0 && input_buf) {
+			value_type x;
+			input_buf >> x;
+			// A value beyond the far end of the heap can never be selected.
+			if (largest ? heap.top_min() < x : x < heap.top_max()) {
+				if (largest)
+					heap.pop_min();
+				else
+					heap.pop_max();
+				heap.push(x);
+				evicted++;
+			}
+		}
+		std::vector<value_type> top(heap.begin(), heap.end());
+		std::sort(top.begin(), top.end());
+		ofbufstream<value_type, Tag> output_buf(buffer_size, output_path);
+		for (auto&& x : top)
+			output_buf << x;
+#ifdef LOGGING
+		m_log["evicted"] = evicted;
+#endif
+	}
+
+	/// @brief Number of values to output.
+	size_t k;
+	/// @brief Whether to output the largest values.
+	bool largest;
+};
+
+} // namespace qy
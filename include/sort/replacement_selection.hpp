@@ -2,15 +2,34 @@
 #include "./base_sorter.hpp"
 #include "bufio/fbufstream.hpp"
 #include "ds/loser_tree.hpp"
+#include "./normalized_key.hpp"
+#include "./output_mode.hpp"
+#include <algorithm>
 #include <vector>
 
 namespace qy {
 
+/// @brief Initial merge segment with its direction.
+struct run_segment {
+	size_t size;	 // Segment length
+	bool descending; // Whether it is stored in descending order, and should be read backward
+};
+
 /// @brief Replacement selection algorithm for external merge sort to produce better initial merge segments.
 /// @tparam T Value type.
-template <class T>
+/// @tparam Mode Output mode, collapsing equal values of a run, see `output_mode.hpp`.
+/// @tparam In Input value type, lifted to `T` by `mode_value` if it differs, which needs a
+/// collapsing mode.
+template <class T, class Mode = keep_all, class In = T>
 class replacement_selection : public base_sorter {
 	using value_type = T;
+	/// @brief Loser tree entry, ordered by round number and then value.
+	using entry = packed_key<value_type>;
+	/// @brief Stream of input and output. Collapsed output lags behind input, so it needs separate
+	/// buffers.
+	using iobuf_type = std::conditional_t<collapses<Mode>,
+										  split_iofbufstream<value_type, In, mode_value<In, Mode>>,
+										  async_iofbufstream<value_type>>;
 
 public:
 	replacement_selection(size_t buffer_size, size_t loser_size) :
@@ -18,30 +37,33 @@ public:
 
 	replacement_selection(size_t buffer_size) : replacement_selection(buffer_size, buffer_size) {}
 
-	std::vector<size_t> operator()(const fs::path& input_path, const fs::path& output_path) {
-		// It can use buffer featuring both input and output.
-		async_iofbufstream<value_type> iobuf(buffer_size, input_path, output_path);
+	/// @param input Path of input file, or an input stream of unknown length.
+	/// @param output_path Path of output file.
+	template <class Input>
+	std::vector<size_t> operator()(Input&& input, const fs::path& output_path) {
+		// It can use buffer featuring both input and output, unless output is collapsed.
+		iobuf_type iobuf(buffer_size, input, output_path);
+		reducing_writer<value_type, Mode, iobuf_type> out(iobuf);
 		// Build loser tree, and insert elements reversely.
-		loser_tree<std::pair<int, value_type>> lt(loser_size);
+		loser_tree<typename entry::word_type> lt(loser_size);
 		for (ssize_t i = loser_size - 1; i >= 0; i--) {
 			if (iobuf.ieof()) { // If input data is not enough, supplement with virtual segs.
-				lt.push_at({2, 0}, i);
+				lt.push_at(entry::pack(2, {}), i);
 				continue;
 			}
 			value_type x;
 			iobuf >> x;
-			lt.push_at({1, x}, i);
+			lt.push_at(entry::pack(1, x), i);
 		}
 		// Get merge segments.
 		std::vector<size_t> seg;
-		for (int rc = 1, rmax = 1; rc <= rmax;) {
-			size_t cnt = 0;
-			while (lt.top().first ==
+		for (uint64_t rc = 1, rmax = 1; rc <= rmax;) {
+			while (entry::high(lt.top()) ==
 				   rc) { // While there still exists a record belonging to this round.
-				int minimax = lt.top().second;
+				value_type minimax = entry::value(lt.top());
 				if (iobuf.ieof()) {
 					// When input EOF, add a virtual record in rmax+1 seg.
-					lt.push({rmax + 1, 0});
+					lt.push(entry::pack(rmax + 1, {}));
 				} else {
 					// The input is not empty, then read in the next record.
 					value_type x;
@@ -49,18 +71,17 @@ public:
 					if (x < minimax) {
 						// If the new record is less than the minimal element in the last round, it belongs to the next round.
 						rmax = rc + 1;
-						lt.push({rmax, x});
+						lt.push(entry::pack(rmax, x));
 					} else {
 						// Else it belongs to this round.
-						lt.push({rc, x});
+						lt.push(entry::pack(rc, x));
 					}
 				}
-				// Output the minimax and increment counter.
-				iobuf << minimax;
-				cnt++;
+				// Output the minimax.
+				out << minimax;
 			}
-			rc = lt.top().first; // Update rc. In fact, it just increment rc by 1.
-			seg.push_back(cnt);
+			rc = entry::high(lt.top()); // Update rc. In fact, it just increment rc by 1.
+			seg.push_back(out.flush());
 		}
 		iobuf.close();
 #ifdef LOGGING
@@ -75,4 +96,131 @@ private:
 	size_t loser_size;
 };
 
+/// @brief Replacement selection emitting runs of either direction.
+/// In a descending run, the tree selects the maximum, and a record greater than the last output
+/// belongs to the next run. Records deferred to the next run take the current direction first. When
+/// the next run starts, it flips direction if those records trend the other way, and the tree is
+/// rebuilt. Thus descending and sawtooth inputs produce long runs.
+/// Values are kept as normalized keys, complemented in descending runs.
+/// @tparam T Value type.
+/// @tparam Mode Output mode, collapsing equal values of a run, see `output_mode.hpp`.
+/// @tparam In Input value type, lifted to `T` by `mode_value` if it differs, which needs a
+/// collapsing mode.
+template <class T, class Mode = keep_all, class In = T>
+class alternating_replacement_selection : public base_sorter {
+	using value_type = T;
+	/// @brief Loser tree entry, ordered by round number and then directed key.
+	using entry = packed_key<value_type>;
+	using key_type = typename entry::key_type;
+	/// @brief Stream of input and output, see `replacement_selection`.
+	using iobuf_type = std::conditional_t<collapses<Mode>,
+										  split_iofbufstream<value_type, In, mode_value<In, Mode>>,
+										  async_iofbufstream<value_type>>;
+
+	static_assert(entry::is_packed, "Value type must have packed keys.");
+
+public:
+	alternating_replacement_selection(size_t buffer_size, size_t loser_size) :
+		base_sorter(buffer_size), loser_size(loser_size) {}
+
+	alternating_replacement_selection(size_t buffer_size) :
+		alternating_replacement_selection(buffer_size, buffer_size) {}
+
+	/// @param input Path of input file, or an input stream of unknown length.
+	/// @param output_path Path of output file.
+	template <class Input>
+	std::vector<run_segment> operator()(Input&& input, const fs::path& output_path) {
+		iobuf_type iobuf(buffer_size, input, output_path);
+		reducing_writer<value_type, Mode, iobuf_type> out(iobuf);
+		// Read the first records, and take their trend as the direction of the first run.
+		std::vector<value_type> init;
+		init.reserve(loser_size);
+		while (init.size() < loser_size && !iobuf.ieof()) {
+			value_type x;
+			iobuf >> x;
+			init.push_back(x);
+		}
+		ptrdiff_t trend = 0; // Number of rising minus falling adjacent inputs
+		for (size_t i = 1; i < init.size(); i++) {
+			trend += (init[i - 1] < init[i]) - (init[i] < init[i - 1]);
+		}
+		std::vector<bool> desc{false, trend < 0}; // Direction of each run
+		auto pack = [&](uint64_t run, value_type x) {
+			key_type k = normalized_key<value_type>::encode(x);
+			return entry::pack_key(run, desc[run] ? key_type(~k) : k);
+		};
+		auto unpack = [&](typename entry::word_type w) {
+			key_type k = entry::key(w);
+			return normalized_key<value_type>::decode(desc[entry::high(w)] ? key_type(~k) : k);
+		};
+		// Build loser tree, and insert elements reversely.
+		loser_tree<typename entry::word_type> lt(loser_size);
+		for (size_t i = 0; i < loser_size; i++) {
+			// If input data is not enough, supplement with virtual segs.
+			lt.push_at(i < init.size() ? pack(1, init[i]) : entry::pack_key(2, 0), loser_size - 1 - i);
+		}
+		// Trend of records deferred to the next round.
+		trend = 0;
+		value_type prev{};
+		// Get merge segments.
+		std::vector<run_segment> seg;
+		size_t flips = 0;
+		for (uint64_t rc = 1, rmax = 1; rc <= rmax;) {
+			while (entry::high(lt.top()) == rc) {
+				value_type minimax = unpack(lt.top());
+				if (iobuf.ieof()) {
+					// When input EOF, add a virtual record in rmax+1 seg.
+					lt.push(entry::pack_key(rmax + 1, 0));
+				} else {
+					value_type x;
+					iobuf >> x;
+					if (desc[rc] ? minimax < x : x < minimax) {
+						// It cannot follow the last output, so it belongs to the next round.
+						if (rmax == rc) {
+							rmax = rc + 1;
+							desc.push_back(desc[rc]);
+						} else {
+							trend += (prev < x) - (x < prev);
+						}
+						prev = x;
+						lt.push(pack(rmax, x));
+					} else {
+						lt.push(pack(rc, x));
+					}
+				}
+				out << minimax;
+			}
+			seg.push_back({out.flush(), desc[rc]});
+			rc = entry::high(lt.top());
+			if (rc <= rmax && trend != 0 && (trend < 0) != desc[rc]) {
+				// Flip the direction of the new round, and rebuild the tree.
+				desc[rc] = !desc[rc];
+				std::vector<typename entry::word_type> data(lt.begin(), lt.end());
+				lt = loser_tree<typename entry::word_type>(loser_size);
+				for (ssize_t i = loser_size - 1; i >= 0; i--) {
+					auto w = data[i];
+					if (entry::high(w) == rc)
+						w = entry::pack_key(rc, key_type(~entry::key(w)));
+					lt.push_at(w, i);
+				}
+				flips++;
+			}
+			trend = 0;
+		}
+		iobuf.close();
+#ifdef LOGGING
+		m_log["loser_size"] = loser_size;
+		m_log["io"] = iobuf.get_log();
+		for (auto&& s : seg)
+			m_log["seg"].push_back(s.size);
+		m_log["desc"] = std::ranges::count_if(seg, &run_segment::descending);
+		m_log["flips"] = flips;
+#endif
+		return seg;
+	}
+
+private:
+	size_t loser_size;
+};
+
 } // namespace qy
\ No newline at end of file
@@ -0,0 +1,289 @@
+#pragma once
+#include "./base_sorter.hpp"
+#include "./replacement_selection.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace qy {
+
+/// @brief Adaptive generation of initial merge segments.
+/// It samples the input for presortedness first. Presorted input is scanned for natural ascending
+/// and descending runs, which are emitted directly as segments. Otherwise, it falls back to
+/// replacement selection, which alternates run directions when values have packed keys.
+/// Descending segments are left for merge readers to read backward, except that a single segment
+/// is reversed blockwise in place, as it is the final output.
+/// @tparam T Value type.
+/// @tparam Mode Output mode, collapsing equal values of a run, see `output_mode.hpp`.
+/// @tparam In Input value type, lifted to `T` by `mode_value` if it differs.
+template <class T, class Mode = keep_all, class In = T>
+class run_generator : public base_sorter {
+	using value_type = T;
+	using input_type = In;
+	constexpr static size_t value_size = sizeof(value_type);
+	constexpr static size_t input_size = sizeof(input_type);
+
+public:
+	/// @brief Minimal fraction of monotone adjacent pairs in samples to take natural runs.
+	constexpr static double presorted_ratio = 0.9;
+	/// @brief Number of blocks sampled.
+	constexpr static size_t sample_count = 16;
+
+	run_generator(size_t buffer_size, size_t loser_size) :
+		base_sorter(buffer_size), loser_size(loser_size) {}
+
+	run_generator(size_t buffer_size) : run_generator(buffer_size, buffer_size) {}
+
+	std::vector<run_segment> operator()(const fs::path& input_path, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+#endif
+		double ratio = sample(input_path);
+		bool natural = ratio >= presorted_ratio;
+#ifdef LOGGING
+		m_log["sample"] = ratio;
+		m_log["natural"] = natural;
+#endif
+		std::vector<run_segment> seg;
+		if (natural)
+			seg = natural_runs(input_path, output_path);
+		else
+			seg = replacement(input_path, output_path);
+		finish(seg, output_path);
+		return seg;
+	}
+
+	/// @brief Generate segments from an input stream of unknown length, such as stdin or a pipe, as
+	/// data arrives. It cannot be sampled ahead, so runs are always made by replacement selection,
+	/// whose alternating form still takes presorted input in long runs.
+	/// @param input Input stream, read until its end.
+	/// @param output_path Path of output file.
+	std::vector<run_segment> operator()(std::istream& input, const fs::path& output_path) {
+#ifdef LOGGING
+		clear_log();
+		m_log["natural"] = false;
+#endif
+		auto seg = replacement(input, output_path);
+		finish(seg, output_path);
+		return seg;
+	}
+
+private:
+	/// @brief Estimate presortedness by evenly spaced blocks.
+	/// @return Average fraction of adjacent pairs in the dominant direction of each block.
+	double sample(const fs::path& input_path) {
+		size_t n = fs::file_size(input_path) / input_size;
+		size_t m = std::min(std::max(buffer_size / sample_count, (size_t)64), n);
+		if (m < 2)
+			return 0.0;
+		std::ifstream fin(input_path, std::ios_base::binary);
+		std::vector<input_type> block(m);
+		double sum = 0.0;
+		for (size_t i = 0; i < sample_count; i++) {
+			fin.seekg((n - m) / (sample_count - 1) * i * input_size, std::ios_base::beg);
+			fin.read(reinterpret_cast<char*>(block.data()), m * input_size);
+			size_t asc = 0, desc = 0;
+			for (size_t j = 1; j < m; j++) {
+				asc += !(block[j] < block[j - 1]);
+				desc += !(block[j - 1] < block[j]);
+			}
+			sum += static_cast<double>(std::max(asc, desc)) / (m - 1);
+		}
+		return sum / sample_count;
+	}
+
+	/// @brief Scan input by blocks of half `buffer_size`, and extend the current run while blocks
+	/// keep its direction. The last block of the run is kept in memory and merged with the next one,
+	/// so that elements displaced by less than a block do not break the run. Blocks that are not
+	/// monotone are sorted in memory.
+	std::vector<run_segment> natural_runs(const fs::path& input_path, const fs::path& output_path) {
+		std::ifstream fin(input_path, std::ios_base::binary);
+		std::fstream fout(output_path, std::ios_base::in | std::ios_base::out |
+										   std::ios_base::binary | std::ios_base::trunc);
+		size_t half = std::max(buffer_size / 2, (size_t)2);
+		std::vector<value_type> block(half * 2);
+		std::vector<run_segment> seg;
+		size_t p = 0; // Size of the pending block at front, not written yet
+		size_t run_first = 0, pos = 0;
+		int dir = 0; // 1 for ascending, -1 for descending, 0 for no run
+		value_type last{};
+		size_t sorted_blocks = 0, merged_blocks = 0;
+		auto before = [&](const value_type& a, const value_type& b) {
+			return dir == 1 ? a < b : b < a;
+		};
+		// Write the first `k` elements, and move the following `rest` ones to front.
+		auto flush = [&](size_t k, size_t rest) {
+			size_t w = k, skip = 0;
+			if constexpr (collapses<Mode>) {
+				w = collapse(block.data(), k);
+				// The first element may equal the last one written of the run.
+				if (pos > run_first && !(last < block[0]) && !(block[0] < last)) {
+					mode(last, block[0]);
+					fout.seekp((pos - 1) * value_size, std::ios_base::beg);
+					fout.write(reinterpret_cast<const char*>(&last), value_size);
+					skip = 1;
+				}
+			}
+			fout.seekp(pos * value_size, std::ios_base::beg);
+			fout.write(reinterpret_cast<const char*>(block.data() + skip), (w - skip) * value_size);
+			pos += w - skip;
+			if (w > skip)
+				last = block[w - 1];
+			std::copy(block.begin() + k, block.begin() + k + rest, block.begin());
+		};
+		// Close the run ending at the current position.
+		auto close_run = [&]() {
+			seg.push_back({pos - run_first, dir == -1});
+			run_first = pos;
+		};
+		while (true) {
+			size_t q = read(fin, block.data() + p, half);
+			if (q == 0)
+				break;
+			auto first = block.begin() + p, last_it = first + q;
+			bool asc = std::is_sorted(first, last_it);
+			bool desc = std::is_sorted(first, last_it, std::greater<>());
+			if (dir == 0) {
+				if (!asc && !desc) {
+					std::sort(first, last_it);
+					asc = true;
+					sorted_blocks++;
+				}
+				dir = asc ? 1 : -1;
+				p = q;
+				continue;
+			}
+			// Blocks that are not monotone can join a run of either direction.
+			bool join = (dir == 1 ? asc : desc) || (!asc && !desc);
+			if (!asc && !desc) {
+				std::sort(first, last_it, before);
+				sorted_blocks++;
+			}
+			// The block cannot go before elements already written.
+			if (join && pos > run_first && before(*first, last))
+				join = false;
+			if (!join) {
+				flush(p, q);
+				close_run();
+				if (!(dir == 1 ? asc : desc) && (asc || desc))
+					dir = -dir;
+				p = q;
+				continue;
+			}
+			if (before(*first, block[p - 1])) {
+				std::inplace_merge(block.begin(), first, last_it, before);
+				merged_blocks++;
+			}
+			flush(p, q);
+			p = q;
+		}
+		if (dir != 0) {
+			flush(p, 0);
+			close_run();
+		}
+#ifdef LOGGING
+		m_log["sorted_blocks"] = sorted_blocks;
+		m_log["merged_blocks"] = merged_blocks;
+		for (auto&& s : seg)
+			m_log["seg"].push_back(s.size);
+		m_log["desc"] = std::ranges::count_if(seg, &run_segment::descending);
+#endif
+		return seg;
+	}
+
+	/// @brief Generate segments by replacement selection, alternating directions if values have
+	/// packed keys.
+	template <class Input>
+	std::vector<run_segment> replacement(Input&& input, const fs::path& output_path) {
+		std::vector<run_segment> seg;
+		if constexpr (packed_key<value_type>::is_packed) {
+			alternating_replacement_selection<value_type, Mode, input_type> repsel(buffer_size,
+																				   loser_size);
+			seg = repsel(input, output_path);
+#ifdef LOGGING
+			m_log["repsel"] = repsel.get_log();
+#endif
+		} else {
+			replacement_selection<value_type, Mode, input_type> repsel(buffer_size, loser_size);
+			for (size_t s : repsel(input, output_path))
+				seg.push_back({s, false});
+#ifdef LOGGING
+			m_log["repsel"] = repsel.get_log();
+#endif
+		}
+		return seg;
+	}
+
+	/// @brief Read up to `n` input values, lifted to values.
+	/// @return Number of values read.
+	size_t read(std::ifstream& fin, value_type* data, size_t n) {
+		if constexpr (std::is_same_v<input_type, value_type>) {
+			fin.read(reinterpret_cast<char*>(data), n * value_size);
+			return fin.gcount() / value_size;
+		} else {
+			raw.resize(n);
+			fin.read(reinterpret_cast<char*>(raw.data()), n * input_size);
+			size_t q = fin.gcount() / input_size;
+			std::transform(raw.begin(), raw.begin() + q, data, mode_value<input_type, Mode>{});
+			return q;
+		}
+	}
+
+	/// @brief Reverse a single descending segment in place, as it is the final output.
+	void finish(std::vector<run_segment>& seg, const fs::path& output_path) {
+		if (seg.size() == 1 && seg[0].descending) {
+			std::fstream f(output_path, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+			std::vector<value_type> buf(std::max(buffer_size, (size_t)2));
+			reverse_run(f, buf.data(), buf.size(), 0, seg[0].size);
+			seg[0].descending = false;
+#ifdef LOGGING
+			m_log["reversed"] = true;
+#endif
+		}
+	}
+
+	/// @brief Collapse adjacent equal values of a sorted range in place.
+	/// @return Number of values left.
+	size_t collapse(value_type* data, size_t n) {
+		size_t w = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (w > 0 && !(data[w - 1] < data[i]) && !(data[i] < data[w - 1]))
+				mode(data[w - 1], data[i]);
+			else
+				data[w++] = data[i];
+		}
+		return w;
+	}
+
+	/// @brief Reverse [first, last) of a file in place, swapping mirrored blocks from both ends.
+	/// @param buf Memory used as two buffers.
+	/// @param buf_size Size of memory.
+	static void reverse_run(std::fstream& f, value_type* buf, size_t buf_size, size_t first,
+							size_t last) {
+		size_t half = std::max(buf_size / 2, (size_t)1);
+		auto lo_buf = buf, hi_buf = buf + half;
+		for (size_t lo = first, hi = last; hi - lo > 1;) {
+			size_t k = std::min(half, (hi - lo) / 2);
+			f.seekg(lo * value_size, std::ios_base::beg);
+			f.read(reinterpret_cast<char*>(lo_buf), k * value_size);
+			f.seekg((hi - k) * value_size, std::ios_base::beg);
+			f.read(reinterpret_cast<char*>(hi_buf), k * value_size);
+			std::reverse(lo_buf, lo_buf + k);
+			std::reverse(hi_buf, hi_buf + k);
+			f.seekp(lo * value_size, std::ios_base::beg);
+			f.write(reinterpret_cast<const char*>(hi_buf), k * value_size);
+			f.seekp((hi - k) * value_size, std::ios_base::beg);
+			f.write(reinterpret_cast<const char*>(lo_buf), k * value_size);
+			lo += k;
+			hi -= k;
+		}
+	}
+
+private:
+	size_t loser_size;
+	/// @brief Output mode.
+	Mode mode{};
+	/// @brief Block of input values to lift, if they differ from values.
+	std::vector<input_type> raw;
+};
+
+} // namespace qy
@@ -0,0 +1,281 @@
+#pragma once
+#include "./external_multiway_merge_sort.hpp"
+#include "./merge_word.hpp"
+#include "ds/loser_tree.hpp"
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace qy {
+
+/// @brief Reader merging sorted files on the fly, as if they were one sorted file.
+/// Equal values are read in the order of files.
+/// @tparam T Value type.
+template <class T>
+class sorted_view {
+public:
+	using value_type = T;
+	/// @brief Loser tree word, packing the file index to break ties by order of files.
+	using word = merge_word<value_type, false>;
+
+	/// @param paths Paths of sorted files.
+	/// @param buffer_size Total size of buffers of all files.
+	sorted_view(std::span<const fs::path> paths, size_t buffer_size) :
+		inputs(paths.size(), {std::max(buffer_size / std::max(paths.size(), (size_t)1), (size_t)16)}),
+		m_tree(0) {
+		std::vector<typename word::word_type> heads(paths.size());
+		for (size_t i = 0; i < paths.size(); i++) {
+			inputs[i].open(paths[i]);
+			inputs[i].seek(0);
+			m_remaining += inputs[i].size();
+			heads[i] = inputs[i] ? word::make(inputs[i].get(), i) : word::exhausted(i);
+		}
+		m_tree = loser_tree<typename word::word_type>(std::move(heads));
+	}
+
+	/// @brief Whether any value remains.
+	inline operator bool() const { return m_remaining > 0; }
+
+	/// @brief Number of remaining values.
+	size_t size() const { return m_remaining; }
+
+	inline sorted_view& operator>>(value_type& x) {
+		size_t i = m_tree.top_index();
+		x = word::value(m_tree.top());
+		m_tree.push(inputs[i] ? word::make(inputs[i].get(), i) : word::exhausted(i));
+		m_remaining--;
+		return *this;
+	}
+
+	/// @brief Read one value.
+	inline value_type get() {
+		value_type x;
+		*this >> x;
+		return x;
+	}
+
+private:
+	/// @brief Input buffers of all files.
+	std::vector<ifbufstream<value_type, double_buffer_tag>> inputs;
+	/// @brief Loser tree of heads of all files.
+	loser_tree<typename word::word_type> m_tree;
+	/// @brief Number of remaining values.
+	size_t m_remaining = 0;
+};
+
+/// @brief Sorted data maintained incrementally as LSM-style levels of sorted files.
+/// New data is sorted alone into a new level, so that the cost of ingesting is proportional to its
+/// size rather than to the whole data. Levels are kept in order of age, and newer levels are merged
+/// into an older one once it is no more than `ratio` times as large as them, so that sizes shrink
+/// geometrically from the oldest level and their number stays logarithmic. A `sorted_view` merges
+/// all levels on the fly.
+/// Levels are files in a directory, so that they are reopened by a later instance. A level is named
+/// `level_<seq>`, or `level_<first>_<last>` if it is merged from the levels of sequence numbers
+/// `first` to `last`. Levels are written under temporary names and renamed once complete, and the
+/// inputs of a merge are removed after its output is renamed. Thus after a crash, partial outputs
+/// and inputs covered by a merged level are discarded on reopening, instead of being adopted.
+/// @tparam T Value type.
+/// @tparam Sorter Sorter of new data.
+template <class T, class Sorter = external_multiway_merge_sorter<T>>
+class sorted_levels : public json_log {
+public:
+	using value_type = T;
+
+	/// @brief A level, as a sorted file.
+	struct level {
+		fs::path path;
+		/// @brief First sequence number of the data merged into the level.
+		size_t first;
+		/// @brief Sequence number, increasing for newer data.
+		size_t seq;
+		/// @brief Number of values.
+		size_t size;
+	};
+
+	/// @param dir Directory of level files. Existing levels in it are reopened.
+	/// @param buffer_size Buffer size of sorting and merging.
+	/// @param ratio Size ratio between adjacent levels.
+	sorted_levels(const fs::path& dir, size_t buffer_size, size_t ratio = 4) :
+		dir(dir), buffer_size(buffer_size), ratio(std::max(ratio, (size_t)1)) {
+		fs::create_directories(dir);
+		std::vector<fs::path> leftovers;
+		for (auto&& entry : fs::directory_iterator(dir)) {
+			auto name = entry.path().filename().string();
+			if (name.starts_with(temp_prefix))
+				leftovers.push_back(entry.path()); // Partial output of a sort or merge
+			else if (auto range = parse(name))
+				m_levels.push_back({entry.path(), range->first, range->second,
+									fs::file_size(entry.path()) / sizeof(value_type)});
+		}
+		// Levels covered by a merged one are inputs of a merge that was cut short after its
+		// output was renamed, so their data is already in it.
+		std::vector<level> kept;
+		for (auto&& l : m_levels) {
+			bool covered = std::ranges::any_of(m_levels, [&](const level& o) {
+				return &o != &l && o.first <= l.first && l.seq <= o.seq;
+			});
+			if (covered)
+				leftovers.push_back(l.path);
+			else
+				kept.push_back(l);
+		}
+		m_levels = std::move(kept);
+		for (auto&& p : leftovers)
+			fs::remove(p);
+		std::ranges::sort(m_levels, {}, &level::seq);
+		if (!m_levels.empty())
+			next_seq = m_levels.back().seq + 1;
+#ifdef LOGGING
+		m_log["ingested"] = 0;
+		m_log["compactions"] = 0;
+		m_log["merged"] = 0;
+#endif
+	}
+
+	/// @brief Adopt an already sorted file as the newest level, such as the output of a full sort.
+	/// The file is moved into the directory, so it should be on the same file system.
+	void add_sorted(const fs::path& path) {
+		size_t n = fs::file_size(path) / sizeof(value_type);
+		if (n == 0)
+			return;
+		size_t seq = next_seq++;
+		auto level_path = make_path(seq, seq);
+		fs::rename(path, level_path);
+		m_levels.push_back({level_path, seq, seq, n});
+		compact();
+	}
+
+	/// @brief Sort new data into the newest level, then compact levels if needed.
+	/// @param delta_path Path of the file of new data, which is left as it is.
+	void ingest(const fs::path& delta_path) {
+		size_t n = fs::file_size(delta_path) / sizeof(value_type);
+		if (n == 0)
+			return;
+		size_t seq = next_seq++;
+		auto temp_path = make_temp_path(seq), level_path = make_path(seq, seq);
+		Sorter sorter(buffer_size);
+		sorter(delta_path, temp_path);
+		fs::rename(temp_path, level_path);
+		m_levels.push_back({level_path, seq, seq, n});
+#ifdef LOGGING
+		jinc<size_t>("ingested", n);
+#endif
+		compact();
+	}
+
+	/// @brief Merge all levels into one.
+	void compact_all() { merge_levels(0); }
+
+	/// @brief Get a reader of all data in order.
+	sorted_view<value_type> view() const {
+		std::vector<fs::path> paths;
+		for (auto&& l : m_levels)
+			paths.push_back(l.path);
+		return {paths, buffer_size};
+	}
+
+	/// @brief Write all data in order to a file.
+	void write(const fs::path& output_path) const {
+		auto input = view();
+		ofbufstream<value_type, double_buffer_tag> output_buf(buffer_size, output_path);
+		while (input)
+			output_buf << input.get();
+	}
+
+	/// @brief Levels from the oldest to the newest.
+	std::span<const level> levels() const { return m_levels; }
+
+	/// @brief Total number of values.
+	size_t size() const {
+		size_t n = 0;
+		for (auto&& l : m_levels)
+			n += l.size;
+		return n;
+	}
+
+private:
+	/// @brief Path of the file of a level.
+	/// @param first First sequence number of the data merged into the level.
+	/// @param seq Sequence number of the level.
+	fs::path make_path(size_t first, size_t seq) const {
+		auto name = prefix + std::to_string(first);
+		if (first != seq)
+			name += "_" + std::to_string(seq);
+		return dir / name;
+	}
+
+	/// @brief Path of the file a level is written to before it is complete.
+	fs::path make_temp_path(size_t seq) const { return dir / (temp_prefix + std::to_string(seq)); }
+
+	/// @brief Get the range of sequence numbers of a level from its file name.
+	/// @return First and last sequence numbers, or none if it is not the name of a level.
+	static std::optional<std::pair<size_t, size_t>> parse(const std::string& name) {
+		if (!name.starts_with(prefix))
+			return std::nullopt;
+		auto rest = name.substr(prefix.size());
+		auto sep = rest.find('_');
+		auto first = rest.substr(0, sep), last = sep == rest.npos ? first : rest.substr(sep + 1);
+		auto is_number = [](const std::string& x) {
+			return !x.empty() && x.find_first_not_of("0123456789") == x.npos;
+		};
+		if (!is_number(first) || !is_number(last))
+			return std::nullopt;
+		return std::pair{std::stoull(first), std::stoull(last)};
+	}
+
+	/// @brief Merge the newest levels while the one before them is not `ratio` times as large.
+	void compact() {
+		size_t first = m_levels.size() - 1, acc = m_levels.back().size;
+		while (first > 0 && m_levels[first - 1].size <= acc * ratio)
+			acc += m_levels[--first].size;
+		merge_levels(first);
+	}
+
+	/// @brief Merge levels from `first` to the newest one into a new level.
+	void merge_levels(size_t first) {
+		if (m_levels.size() - first <= 1)
+			return;
+		std::vector<fs::path> paths;
+		for (size_t i = first; i < m_levels.size(); i++)
+			paths.push_back(m_levels[i].path);
+		// The merged level covers the sequence numbers of its inputs.
+		size_t first_seq = m_levels[first].first, seq = m_levels.back().seq;
+		auto temp_path = make_temp_path(seq), level_path = make_path(first_seq, seq);
+		size_t n = 0;
+		{
+			sorted_view<value_type> input(paths, buffer_size);
+			ofbufstream<value_type, double_buffer_tag> output_buf(buffer_size, temp_path);
+			for (; input; n++)
+				output_buf << input.get();
+		}
+		fs::rename(temp_path, level_path);
+		for (auto&& p : paths)
+			fs::remove(p);
+		m_levels.resize(first);
+		m_levels.push_back({level_path, first_seq, seq, n});
+#ifdef LOGGING
+		jinc("compactions");
+		jinc<size_t>("merged", n);
+		m_log["levels"] = m_levels.size();
+#endif
+	}
+
+	/// @brief Prefix of names of level files.
+	inline static const std::string prefix = "level_";
+	/// @brief Prefix of names of level files being written.
+	inline static const std::string temp_prefix = ".level_temp_";
+
+	/// @brief Directory of level files.
+	fs::path dir;
+	/// @brief Buffer size of sorting and merging.
+	size_t buffer_size;
+	/// @brief Size ratio between adjacent levels.
+	size_t ratio;
+	/// @brief Levels from the oldest to the newest.
+	std::vector<level> m_levels;
+	/// @brief Sequence number of the next level.
+	size_t next_seq = 0;
+};
+
+} // namespace qy
@@ -0,0 +1,112 @@
+#pragma once
+#include "./merge_word.hpp"
+#include "ds/inline_loser_tree.hpp"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace qy {
+
+/// @brief Hierarchical merger of many runs.
+/// Runs are split into groups, each merged by a small loser tree resident in L1 cache into a short
+/// block in memory. A top-level loser tree merges the heads of blocks. Thus each element costs a
+/// replay in a small group tree, and a replay in the top tree once per element as well, but both
+/// touch only a few cache lines, instead of log2(k) lines scattered over a large tree.
+/// Since groups read ahead of the global order, inputs should not rely on forecasting by the
+/// merge order, as `ifbufstream_pool` does.
+/// @tparam T Value type.
+/// @tparam Inputs Random-access container of input streams.
+template <class T, class Inputs>
+class two_level_merger {
+	using value_type = T;
+	using word = merge_word<value_type>;
+	using word_type = typename word::word_type;
+	using tree_type = std::conditional_t<std::is_trivially_copyable_v<word_type>,
+										 inline_loser_tree<word_type>, loser_tree<word_type>>;
+
+	/// @brief A group of runs merged into a block.
+	struct group {
+		size_t first;		  // Index of the first run
+		size_t remaining;	  // Number of elements not merged into the block yet
+		tree_type tree;		  // Loser tree of runs
+		std::vector<T> block; // Merged block
+		size_t pos = 0;		  // Read position in block
+	};
+
+public:
+	/// @brief Default number of runs in a group, so that a group tree fits in a few cache lines.
+	constexpr static size_t default_group_size = 64;
+	/// @brief Default number of elements in a block.
+	constexpr static size_t default_block_size = 256;
+
+	/// @brief Construct a merger of all inputs.
+	/// @param inputs Input streams, each holding a sorted run.
+	/// @param sizes Number of elements of each run.
+	/// @param group_size Number of runs in a group.
+	/// @param block_size Number of elements in a block.
+	two_level_merger(Inputs& inputs, const std::vector<size_t>& sizes,
+					 size_t group_size = default_group_size, size_t block_size = default_block_size) :
+		m_inputs(inputs), m_block_size(block_size) {
+		size_t k = sizes.size();
+		std::vector<word_type> heads;
+		for (size_t first = 0; first < k; first += group_size) {
+			size_t last = std::min(first + group_size, k), remaining = 0;
+			std::vector<word_type> run_heads;
+			for (size_t i = first; i < last; i++) {
+				run_heads.push_back(word::make(m_inputs[i].get(), i - first));
+				remaining += sizes[i];
+			}
+			m_groups.push_back({first, remaining, tree_type(run_heads), {}});
+			heads.push_back(refill(m_groups.back(), m_groups.size() - 1));
+		}
+		m_top = std::make_unique<tree_type>(heads);
+	}
+
+	/// @brief Get the least element, and advance. The caller should count elements to stop.
+	value_type pop() {
+		size_t g = m_top->top_index();
+		value_type x = word::value(m_top->top());
+		auto& gr = m_groups[g];
+		m_top->push(gr.pos < gr.block.size() ? word::make(gr.block[gr.pos++], g) : refill(gr, g));
+		return x;
+	}
+
+	/// @brief Number of groups.
+	size_t group_count() const { return m_groups.size(); }
+
+private:
+	/// @brief Merge the next block of a group, and take its first element.
+	/// @return Word of the first element, or the sentinel if the group is exhausted.
+	word_type refill(group& gr, size_t g) {
+		size_t n = std::min(m_block_size, gr.remaining);
+		if (n == 0)
+			return word::exhausted(g);
+		gr.block.resize(n);
+		gr.remaining -= n;
+		for (auto&& y : gr.block) {
+			size_t i = gr.tree.top_index();
+			y = word::value(gr.tree.top());
+			auto& input = m_inputs[gr.first + i];
+			if (input) {
+				value_type x;
+				input >> x;
+				gr.tree.push(word::make(x, i));
+			} else {
+				gr.tree.push(word::exhausted(i));
+			}
+		}
+		gr.pos = 1;
+		return word::make(gr.block[0], g);
+	}
+
+	/// @brief Input streams.
+	Inputs& m_inputs;
+	/// @brief Number of elements in a block.
+	size_t m_block_size;
+	/// @brief Groups of runs.
+	std::vector<group> m_groups;
+	/// @brief Top-level tree over groups.
+	std::unique_ptr<tree_type> m_top;
+};
+
+} // namespace qy
@@ -2,6 +2,7 @@
 #include "./futils.hpp"
 #include "./timer.hpp"
 #include "sort/base_sorter.hpp"
+#include "sort/merge_planner.hpp"
 #include <expected>
 #include <fmt/chrono.h>
 #include <fmt/color.h>
@@ -31,6 +32,9 @@ public:
 
 	static void init() {
 		fmt::print("Tester Init\n");
+		// Merges of all test data are planned by a fixed SSD model, so that timings are comparable
+		// across machines and runs, and no calibration is timed inside the first sort.
+		device_model::assume(fs::current_path() / "test" / "data", {1e-4, 5e8});
 		// fmt::print("Current path: {}\n", fs::current_path().string());
 		// fs::current_path(fs::absolute(__FILE__).parent_path().parent_path());
 		// fmt::print("Change cwd: {}\n", fs::current_path().string());
@@ -0,0 +1,110 @@
+#include "ds/inline_loser_tree.hpp"
+#include "ds/loser_tree.hpp"
+#include "ds/tournament_selector.hpp"
+#include "sort/merge_word.hpp"
+#include "sort/two_level_merger.hpp"
+#include "utils/timer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace qy;
+
+/// @brief Merge sorted runs in memory by a loser tree, as the multiway merge sorter does.
+template <class Tree, class Word, class T>
+std::vector<T> merge_runs(const std::vector<std::vector<T>>& runs) {
+	size_t k = runs.size(), total = 0;
+	std::vector<size_t> pos(k, 1);
+	std::vector<typename Word::word_type> heads(k);
+	for (size_t i = 0; i < k; i++) {
+		heads[i] = Word::make(runs[i][0], i);
+		total += runs[i].size();
+	}
+	std::vector<T> out;
+	out.reserve(total);
+	Tree lt(heads);
+	for (; total > 0; total--) {
+		size_t i = lt.top_index();
+		out.push_back(Word::value(lt.top()));
+		if (pos[i] < runs[i].size())
+			lt.push(Word::make(runs[i][pos[i]++], i));
+		else
+			lt.push(Word::exhausted(i));
+	}
+	return out;
+}
+
+/// @brief In-memory run with the interface of input streams.
+template <class T>
+struct run_reader {
+	const std::vector<T>* run;
+	size_t pos = 0;
+
+	T get() { return (*run)[pos++]; }
+
+	run_reader& operator>>(T& x) {
+		x = get();
+		return *this;
+	}
+
+	operator bool() const { return pos < run->size(); }
+};
+
+/// @brief Merge sorted runs in memory by a two-level merger.
+template <class T>
+std::vector<T> merge_runs_two_level(const std::vector<std::vector<T>>& runs) {
+	std::vector<run_reader<T>> inputs;
+	std::vector<size_t> sizes;
+	for (auto&& r : runs) {
+		inputs.push_back({&r});
+		sizes.push_back(r.size());
+	}
+	std::vector<T> out(std::accumulate(sizes.begin(), sizes.end(), (size_t)0));
+	two_level_merger<T, std::vector<run_reader<T>>> merger(inputs, sizes);
+	for (auto&& x : out)
+		x = merger.pop();
+	return out;
+}
+
+template <class T>
+void bench(const char* name, size_t n) {
+	std::mt19937_64 rng(0);
+	for (size_t k : {2, 3, 4, 8, 16, 64, 256, 1024, 4096}) {
+		std::vector<std::vector<T>> runs(k, std::vector<T>(n / k));
+		for (auto&& r : runs) {
+			for (auto&& x : r)
+				x = static_cast<T>(rng() % 1000000000);
+			std::ranges::sort(r);
+		}
+		using packed = merge_word<T, false>;
+		using bare = merge_word<T, true>;
+		using word_type = typename packed::word_type;
+		std::vector<T> out1, out2, out3, out4;
+		auto t1 = func_timer([&]() { out1 = merge_runs<loser_tree<word_type>, packed>(runs); });
+		auto t2 = func_timer([&]() { out2 = merge_runs<inline_loser_tree<word_type>, packed>(runs); });
+		auto t3 = func_timer([&]() { out3 = merge_runs<inline_loser_tree<T>, bare>(runs); });
+		bool ok = out1 == out2 && out1 == out3 && std::ranges::is_sorted(out2);
+		printf("%s k=%-5zu loser_tree %6.2f ns/elem, inline_loser_tree %6.2f ns/elem, bare %6.2f ns/elem",
+			   name, k, (double)t1.count() / n, (double)t2.count() / n, (double)t3.count() / n);
+		if (k <= tournament_selector<typename packed::entry>::max_size) {
+			auto t4 = func_timer(
+				[&]() { out4 = merge_runs<tournament_selector<typename packed::entry>, packed>(runs); });
+			ok = ok && out1 == out4;
+			printf(", tournament_selector %6.2f ns/elem", (double)t4.count() / n);
+		}
+		if (k >= 64) {
+			auto t5 = func_timer([&]() { out4 = merge_runs_two_level(runs); });
+			ok = ok && out1 == out4;
+			printf(", two_level_merger %6.2f ns/elem", (double)t5.count() / n);
+		}
+		printf(", %s\n", ok ? "OK" : "WRONG");
+	}
+}
+
+int main() {
+	bench<int32_t>("i32", 1 << 22);
+	bench<double>("f64", 1 << 22);
+	return 0;
+}
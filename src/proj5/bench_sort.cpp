@@ -0,0 +1,70 @@
+#define LOGGING
+#include "sort/external_sort.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace qy;
+
+/// @brief Sort by a sorter, and print its time and whether the output is sorted.
+template <class T, class Sorter>
+void bench_sorter(const char* name, Sorter&& sorter, const fs::path& in_path,
+				  const fs::path& out_path, const std::vector<T>& ans) {
+	auto t = func_timer(sorter, in_path, out_path);
+	bool ok = read_binary_file<T>(out_path) == ans;
+	printf(", %s %7.1f ms%s", name, (double)t.count() / 1e6, ok ? "" : " WRONG");
+}
+
+/// @brief Time every sorter the facade chooses from, with the buffer sizes it gives them, on the
+/// same input, and print the strategy it chooses.
+template <class T>
+void bench(const char* name, std::vector<T> a, size_t budget) {
+	auto in_path = fs::path("bench_sort.in"), out_path = fs::path("bench_sort.out");
+	{
+		std::ofstream fout(in_path, std::ios_base::binary | std::ios_base::trunc);
+		fout.write(reinterpret_cast<const char*>(a.data()), a.size() * sizeof(T));
+	}
+	std::ranges::sort(a);
+	size_t buffer_size = budget / sizeof(T);
+	printf("%-10s budget=%-8zu", name, budget);
+	bench_sorter("quick", external_quick_sorter<T>(buffer_size / 9), in_path, out_path, a);
+	bench_sorter("multiway", external_multiway_merge_sorter<T>(buffer_size / 4), in_path,
+				 out_path, a);
+	bench_sorter("radix", external_radix_sorter<T>(buffer_size / 2), in_path, out_path, a);
+	if constexpr (small_domain<T>)
+		bench_sorter("counting", external_counting_sorter<T>(buffer_size), in_path, out_path, a);
+	printf(", auto: %s\n", to_string(external_sort<T>(in_path, out_path, budget)));
+	fs::remove(in_path);
+	fs::remove(out_path);
+}
+
+template <class T>
+std::vector<T> generate(size_t n, int64_t rmin, int64_t rmax, bool presorted = false) {
+	std::vector<T> a(n);
+	std::mt19937_64 rng(0);
+	std::uniform_int_distribution<int64_t> distrib(rmin, rmax);
+	for (auto&& x : a)
+		x = (T)distrib(rng);
+	if (presorted) {
+		std::ranges::sort(a);
+		// Displace a few values, so that it is nearly sorted.
+		for (size_t i = 0; i + 1 < n; i += 64)
+			std::swap(a[i], a[i + 1]);
+	}
+	return a;
+}
+
+int main() {
+	constexpr size_t n = 1 << 22;
+	for (size_t budget : {1 << 16, 1 << 20, 1 << 24}) {
+		bench("i16", generate<int16_t>(n, INT16_MIN, INT16_MAX), budget);
+		bench("i32", generate<int32_t>(n, 0, 1 << 30), budget);
+		bench("i64", generate<int64_t>(n, 0, 1ll << 40), budget);
+		bench("i64 dup", generate<int64_t>(n, 0, 15), budget);
+		bench("i64 sorted", generate<int64_t>(n, 0, 1ll << 40, true), budget);
+	}
+	return 0;
+}
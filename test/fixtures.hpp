@@ -0,0 +1,59 @@
+#pragma once
+#include "sort/keyed_record.hpp"
+#include "utils/futils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <fstream>
+#include <random>
+#include <ranges>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/// @brief Record with a key and a payload, shared by tests of records.
+struct account {
+	int64_t key;
+	int64_t amount;
+};
+
+using account_record = qy::keyed_record<account, &account::key>;
+
+/// @brief Write an array to a binary file, replacing it.
+/// @param path The path of file.
+/// @param a A contiguous range of values.
+template <std::ranges::contiguous_range R>
+void write_binary_file(const qy::fs::path& path, const R& a) {
+	std::ofstream fout(path, std::ios_base::binary | std::ios_base::trunc);
+	fout.write(reinterpret_cast<const char*>(std::ranges::data(a)),
+			   std::ranges::size(a) * sizeof(std::ranges::range_value_t<R>));
+}
+
+/// @brief Generate random values uniformly in [rmin, rmax], by a fixed seed.
+/// @tparam T Value type, arithmetic or a `keyed_record` whose first field is its key. The range
+/// should fit in the value or key type.
+/// @param presorted Whether to sort the values.
+/// @return Values, or records with the value as key and other fields zero.
+template <class T>
+std::vector<T> generate(size_t num, int64_t rmin, int64_t rmax, bool presorted = false) {
+	std::vector<T> a(num);
+	std::mt19937 rng(0);
+	std::uniform_int_distribution<int64_t> distrib(rmin, rmax);
+	for (auto&& x : a) {
+		if constexpr (std::is_arithmetic_v<T>)
+			x = (T)distrib(rng);
+		else
+			x = {{(typename T::key_type)distrib(rng)}};
+	}
+	if (presorted)
+		std::ranges::sort(a);
+	return a;
+}
+
+/// @brief Print the name of a test, its verdict and its time.
+inline void print_result(std::string_view name, bool ok, std::chrono::nanoseconds t) {
+	fmt::print(fmt::fg(fmt::color::yellow), "Test {}\n", name);
+	fmt::print(fmt::fg(ok ? fmt::color::lime_green : fmt::color::red), "  {} {}ms\n",
+			   ok ? "AC" : "WA", t.count() / 1000000);
+}
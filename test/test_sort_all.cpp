@@ -3,9 +3,11 @@
 // #pragma GCC target("avx,sse2,sse3,sse4,mmx")
 // #define DEBUG
 #define LOGGING
+#include "sort/external_counting_sort.hpp"
 #include "sort/external_merge_sort.hpp"
 #include "sort/external_multiway_merge_sort.hpp"
 #include "sort/external_quick_sort.hpp"
+#include "sort/external_radix_sort.hpp"
 #include "sort/external_twoway_merge_sort.hpp"
 #include "utils/judge.hpp"
 
@@ -31,6 +33,9 @@ struct judge_impl {
 			J.test_sort(external_merge_sorter<T>(s));
 			J.test_sort(external_twoway_merge_sorter<T>(s));
 			J.test_sort(external_multiway_merge_sorter<T>(s));
+			J.test_sort(external_radix_sorter<T>(s));
+			if constexpr (small_domain<T>)
+				J.test_sort(external_counting_sorter<T>(s));
 			J.dump_result(result_path);
 		}
 	}
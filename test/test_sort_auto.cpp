@@ -0,0 +1,73 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/external_sort.hpp"
+#include "sort/keyed_record.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <nameof.hpp>
+#include <sstream>
+
+using namespace qy;
+
+/// @brief Sort by the facade, and check both the output and the strategy chosen.
+template <class T>
+void test_auto(std::string_view name, const std::vector<T>& a, size_t budget,
+			   sort_strategy expected, const fs::path& in_path, const fs::path& out_path) {
+	fmt::print(fmt::fg(fmt::color::yellow), "Test {} {} {}\n", nameof::nameof_type<T>(), name,
+			   budget);
+	write_binary_file(in_path, a);
+	sort_strategy strategy;
+	auto t = func_timer([&]() { strategy = external_sort<T>(in_path, out_path, budget); });
+	auto out = read_binary_file<T>(out_path);
+	auto ans = a;
+	std::ranges::sort(ans);
+	bool ok = strategy == expected &&
+			  std::ranges::equal(out, ans, [](auto&& x, auto&& y) { return !(x < y) && !(y < x); });
+	fmt::print(fmt::fg(ok ? fmt::color::lime_green : fmt::color::red), "  {} {} {}ms\n",
+			   ok ? "AC" : "WA", to_string(strategy), t.count() / 1000000);
+}
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	auto in_path = data_path / "auto.in", out_path = data_path / "auto.out";
+	constexpr size_t num = 1000000;
+	for (size_t budget : {1 << 16, 1 << 20}) {
+		// Buckets of radix sort are too small in the smaller budget.
+		auto distinct = budget < (1 << 20) ? sort_strategy::multiway : sort_strategy::radix;
+		test_auto("small", generate<int64_t>(1000, 0, 1 << 30), budget, sort_strategy::in_memory,
+				  in_path, out_path);
+		test_auto("domain", generate<int16_t>(num, INT16_MIN, INT16_MAX), budget,
+				  sort_strategy::counting, in_path, out_path);
+		test_auto("distinct", generate<int32_t>(num, 0, 1 << 30), budget, distinct, in_path,
+				  out_path);
+		test_auto("distinct", generate<int64_t>(num, 0, 1ll << 40), budget, distinct, in_path,
+				  out_path);
+		test_auto("duplicates", generate<int64_t>(num, 0, 15), budget, sort_strategy::quick,
+				  in_path, out_path);
+		test_auto("presorted", generate<int64_t>(num, 0, 1ll << 40, true), budget,
+				  sort_strategy::multiway, in_path, out_path);
+		test_auto("records", generate<account_record>(num, 0, 1 << 30), budget,
+				  sort_strategy::multiway, in_path, out_path);
+	}
+
+	// A stream cannot be sampled.
+	auto a = generate<int32_t>(num, 0, 1 << 30);
+	std::stringstream input(
+		std::string(reinterpret_cast<const char*>(a.data()), a.size() * sizeof(int32_t)),
+		std::ios_base::in | std::ios_base::binary);
+	auto_sorter<int32_t> sorter(1 << 20);
+	auto t = func_timer([&]() { sorter(input, out_path); });
+	std::ranges::sort(a);
+	bool ok =
+		sorter.strategy() == sort_strategy::multiway && read_binary_file<int32_t>(out_path) == a;
+	fmt::print(fmt::fg(fmt::color::yellow), "Test stream\n");
+	fmt::print(fmt::fg(ok ? fmt::color::lime_green : fmt::color::red), "  {} {}ms\n",
+			   ok ? "AC" : "WA", t.count() / 1000000);
+	return 0;
+}
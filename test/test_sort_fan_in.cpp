@@ -0,0 +1,45 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/external_multiway_merge_sort.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/core.h>
+
+using namespace qy;
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	auto in_path = data_path / "fan_in.in", out_path = data_path / "fan_in.out";
+
+	// Blocks of half the buffer sorted in alternating directions are natural runs, one per block,
+	// as many as the two-level order.
+	using sorter_type = external_multiway_merge_sorter<int32_t>;
+	constexpr size_t k = sorter_type::large_order;
+	size_t min_block = sorter_type::min_block_bytes / sizeof(int32_t);
+	size_t s = (k + 1) * min_block / 2 + 1024, half = s / 2;
+	auto a = generate<int32_t>(k * half, 0, 1 << 30);
+	for (size_t i = 0; i < a.size(); i += half) {
+		if (i / half % 2 == 0)
+			std::sort(a.begin() + i, a.begin() + i + half);
+		else
+			std::sort(a.begin() + i, a.begin() + i + half, std::greater<>());
+	}
+	write_binary_file(in_path, a);
+
+	// A device without seek cost merges all runs in one pass.
+	sorter_type sorter(s);
+	sorter.set_device({1e-6, 5e8});
+	auto t = func_timer(sorter, in_path, out_path);
+	std::ranges::sort(a);
+	auto log = sorter.get_log();
+	bool ok = read_binary_file<int32_t>(out_path) == a && log["selector"] == "two_level" &&
+			  log["plan"]["fan_in"].size() == 1;
+	print_result(fmt::format("two-level merge of {} runs", k), ok, t);
+	fs::remove(in_path);
+	fs::remove(out_path);
+	return 0;
+}
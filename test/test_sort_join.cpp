@@ -0,0 +1,146 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/merge_join.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <map>
+#include <nameof.hpp>
+#include <random>
+#include <set>
+
+using namespace qy;
+
+struct order {
+	int32_t customer;
+	int32_t amount;
+};
+
+struct customer {
+	int32_t id;
+	int32_t region;
+};
+
+using order_record = keyed_record<order, &order::customer>;
+using customer_record = keyed_record<customer, &customer::id>;
+
+/// @brief Compare joined pairs by fields, as records have padding.
+bool same_pairs(const std::vector<joined<order_record, customer_record>>& out,
+				const std::vector<std::tuple<int32_t, int32_t, int32_t, bool>>& ans) {
+	std::vector<std::tuple<int32_t, int32_t, int32_t, bool>> got;
+	for (auto&& p : out)
+		got.emplace_back(p.left.value.customer, p.left.value.amount,
+						 p.matched ? p.right.value.region : -1, p.matched);
+	std::ranges::sort(got);
+	return got == ans;
+}
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	auto left_path = data_path / "join_left.in", right_path = data_path / "join_right.in",
+		 out_path = data_path / "join.out";
+	std::mt19937 rng(0);
+	// Few keys with many duplicates on both sides, so that groups exceed small buffers.
+	for (auto [num, keys] : {std::pair{200000, 100000}, std::pair{5000, 5}}) {
+		std::uniform_int_distribution<int32_t> key(0, keys);
+		std::vector<order_record> orders(num);
+		std::vector<customer_record> customers(num / 10);
+		for (int32_t i = 0; i < num; i++)
+			orders[i] = {{key(rng), i}};
+		for (int32_t i = 0; i < num / 10; i++)
+			customers[i] = {{key(rng), i}};
+		write_binary_file(left_path, orders);
+		write_binary_file(right_path, customers);
+
+		std::multimap<int32_t, int32_t> regions;
+		for (auto&& c : customers)
+			regions.emplace(c.value.id, c.value.region);
+		std::vector<std::tuple<int32_t, int32_t, int32_t, bool>> inner, left;
+		std::vector<std::pair<int32_t, int32_t>> semi, anti;
+		for (auto&& o : orders) {
+			auto [first, last] = regions.equal_range(o.value.customer);
+			for (auto it = first; it != last; ++it) {
+				inner.emplace_back(o.value.customer, o.value.amount, it->second, true);
+				left.emplace_back(o.value.customer, o.value.amount, it->second, true);
+			}
+			if (first == last)
+				left.emplace_back(o.value.customer, o.value.amount, -1, false);
+			(first == last ? anti : semi).emplace_back(o.value.customer, o.value.amount);
+		}
+		std::ranges::sort(inner);
+		std::ranges::sort(left);
+		std::ranges::sort(semi);
+		std::ranges::sort(anti);
+		auto records_equal = [&](const fs::path& path, auto& ans) {
+			std::vector<std::pair<int32_t, int32_t>> got;
+			for (auto&& o : read_binary_file<order_record>(path))
+				got.emplace_back(o.value.customer, o.value.amount);
+			std::ranges::sort(got);
+			return got == ans;
+		};
+
+		for (size_t s : {1 << 6, 1 << 14}) {
+			auto t = func_timer(merge_joiner<order_record, customer_record>(s), left_path, right_path,
+								out_path);
+			print_result(fmt::format("inner join {} {}", num, s),
+						 same_pairs(read_binary_file<joined<order_record, customer_record>>(out_path),
+									inner),
+						 t);
+			t = func_timer(merge_joiner<order_record, customer_record, join_kind::left>(s), left_path,
+						   right_path, out_path);
+			print_result(fmt::format("left join {} {}", num, s),
+						 same_pairs(read_binary_file<joined<order_record, customer_record>>(out_path),
+									left),
+						 t);
+			t = func_timer(merge_joiner<order_record, customer_record, join_kind::semi>(s), left_path,
+						   right_path, out_path);
+			print_result(fmt::format("semi join {} {}", num, s), records_equal(out_path, semi), t);
+			t = func_timer(merge_joiner<order_record, customer_record, join_kind::anti>(s), left_path,
+						   right_path, out_path);
+			print_result(fmt::format("anti join {} {}", num, s), records_equal(out_path, anti), t);
+		}
+	}
+
+	// Set operations of three files of values.
+	std::vector<fs::path> paths;
+	std::vector<std::set<int32_t>> sets(3);
+	for (size_t i = 0; i < 3; i++) {
+		std::vector<int32_t> a(100000);
+		std::uniform_int_distribution<int32_t> value(0, 200000);
+		for (auto&& x : a) {
+			x = value(rng);
+			sets[i].insert(x);
+		}
+		// The first file is sorted already, others are sorted by the operator.
+		if (i == 0)
+			std::ranges::sort(a);
+		paths.push_back(data_path / fmt::format("set_{}.in", i));
+		write_binary_file(paths.back(), a);
+	}
+	std::vector<int32_t> intersect, subtract, unite;
+	for (int32_t x = 0; x <= 200000; x++) {
+		bool in0 = sets[0].contains(x), in1 = sets[1].contains(x), in2 = sets[2].contains(x);
+		if (in0 && in1 && in2)
+			intersect.push_back(x);
+		if (in0 && !in1 && !in2)
+			subtract.push_back(x);
+		if (in0 || in1 || in2)
+			unite.push_back(x);
+	}
+	for (size_t s : {1 << 8, 1 << 14}) {
+		auto t = func_timer(merge_set_operator<int32_t, set_kind::intersect>(s), paths, out_path);
+		print_result(fmt::format("intersect {}", s), read_binary_file<int32_t>(out_path) == intersect,
+					 t);
+		t = func_timer(merge_set_operator<int32_t, set_kind::subtract>(s), paths, out_path);
+		print_result(fmt::format("subtract {}", s), read_binary_file<int32_t>(out_path) == subtract,
+					 t);
+		t = func_timer(merge_set_operator<int32_t, set_kind::unite>(s), paths, out_path);
+		print_result(fmt::format("unite {}", s), read_binary_file<int32_t>(out_path) == unite, t);
+	}
+	return 0;
+}
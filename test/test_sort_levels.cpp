@@ -0,0 +1,75 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/sorted_levels.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <random>
+
+using namespace qy;
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	auto levels_path = data_path / "levels";
+	if (fs::exists(levels_path))
+		fs::remove_all(levels_path);
+	fs::create_directories(levels_path);
+
+	// An existing sorted output, then deltas of various sizes appended.
+	std::vector<int32_t> a(1000000);
+	std::mt19937 rng(0);
+	std::uniform_int_distribution<int32_t> distrib;
+	for (auto&& x : a)
+		x = distrib(rng);
+	auto delta_path = data_path / "levels.in", out_path = data_path / "levels.out";
+	std::vector<int32_t> all(a.begin(), a.begin() + 500000);
+	std::ranges::sort(all);
+	write_binary_file(delta_path, all);
+
+	size_t s = 1 << 12;
+	bool ok = true;
+	auto t = func_timer([&]() {
+		sorted_levels<int32_t> levels(levels_path, s);
+		levels.add_sorted(delta_path);
+		std::uniform_int_distribution<size_t> delta_size(1, 20000);
+		for (size_t first = all.size(); first < a.size();) {
+			size_t n = std::min(delta_size(rng), a.size() - first);
+			write_binary_file(delta_path, std::span(a).subspan(first, n));
+			levels.ingest(delta_path);
+			first += n;
+			// Sizes of levels shrink geometrically.
+			ok &= levels.levels().size() <= 12;
+		}
+		fmt::print("{}\n", levels.get_log_str());
+	});
+
+	// Leftovers of crashes: a partial output, and an input of a merge whose output was renamed.
+	std::vector<int32_t> junk(1000, 0);
+	write_binary_file(levels_path / ".level_temp_999", junk);
+	fs::path covered;
+	for (auto&& entry : fs::directory_iterator(levels_path)) {
+		auto name = entry.path().filename().string();
+		if (auto sep = name.rfind('_'); name.starts_with("level_") && sep > 5)
+			covered = levels_path / name.substr(0, sep);
+	}
+	ok &= !covered.empty();
+	write_binary_file(covered, junk);
+
+	// Reopen the levels, and read them through the view and after compaction.
+	std::ranges::sort(a);
+	sorted_levels<int32_t> levels(levels_path, s);
+	ok &= !fs::exists(levels_path / ".level_temp_999") && !fs::exists(covered);
+	ok &= levels.size() == a.size();
+	auto view = levels.view();
+	for (size_t i = 0; view; i++)
+		ok &= view.get() == a[i];
+	levels.compact_all();
+	levels.write(out_path);
+	ok &= levels.levels().size() == 1 && read_binary_file<int32_t>(out_path) == a;
+
+	print_result("sorted_levels", ok, t);
+	return 0;
+}
@@ -0,0 +1,121 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/external_counting_sort.hpp"
+#include "sort/external_multiway_merge_sort.hpp"
+#include "sort/external_twoway_merge_sort.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <map>
+#include <nameof.hpp>
+
+using namespace qy;
+
+struct add_amount {
+	account_record operator()(account_record a, const account_record& b) const {
+		a.value.amount += b.value.amount;
+		return a;
+	}
+};
+
+template <class T, class Sorter, class Eq>
+void test_mode(Sorter&& sorter, const fs::path& in_path, const std::vector<T>& ans, Eq eq) {
+	fs::path out_path = in_path;
+	out_path.replace_extension(".out");
+	auto t = func_timer(sorter, in_path, out_path);
+	auto out = read_binary_file<T>(out_path);
+	print_result(nameof::nameof_type<Sorter>(), std::ranges::equal(out, ans, eq), t);
+}
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	for (auto [num, rmax] : {std::pair{100000uz, 1 << 30}, std::pair{100000uz, 100}}) {
+		auto a = generate<int64_t>(num, 0, rmax);
+		auto in_path = data_path / fmt::format("mode_{}_{}.in", num, rmax);
+
+		// Unique values, as `sort | uniq`.
+		std::map<int64_t, int64_t> counts, sums;
+		for (size_t i = 0; i < num; i++) {
+			counts[a[i]]++;
+			sums[a[i]] += i;
+		}
+		std::vector<int64_t> uniq;
+		for (auto [k, c] : counts)
+			uniq.push_back(k);
+		write_binary_file(in_path, a);
+		for (size_t s : {1 << 10, 1 << 12}) {
+			test_mode(external_multiway_merge_sorter<int64_t, keep_unique>(s), in_path, uniq,
+					  std::equal_to<>());
+			test_mode(external_twoway_merge_sorter<int64_t, keep_unique>(s), in_path, uniq,
+					  std::equal_to<>());
+		}
+
+		// Counts of values, as `sort | uniq -c`, lifted from plain values first.
+		std::vector<counted_record<int64_t>> records(num), counted_ans;
+		for (size_t i = 0; i < num; i++)
+			records[i] = {{a[i], 1}};
+		for (auto [k, c] : counts)
+			counted_ans.push_back({{k, (uint64_t)c}});
+		auto counted_eq = [](auto&& x, auto&& y) {
+			return x.value.value == y.value.value && x.value.count == y.value.count;
+		};
+		for (size_t s : {1 << 10, 1 << 12}) {
+			test_mode(external_multiway_merge_sorter<int64_t, count_keys>(s), in_path, counted_ans,
+					  counted_eq);
+			test_mode(external_twoway_merge_sorter<int64_t, count_keys>(s), in_path, counted_ans,
+					  counted_eq);
+		}
+		write_binary_file(in_path, records);
+		for (size_t s : {1 << 10, 1 << 12}) {
+			test_mode(external_multiway_merge_sorter<counted_record<int64_t>, count_keys>(s), in_path,
+					  counted_ans, counted_eq);
+			test_mode(external_twoway_merge_sorter<counted_record<int64_t>, count_keys>(s), in_path,
+					  counted_ans, counted_eq);
+		}
+
+		// Sums of amounts by key.
+		std::vector<account_record> accounts(num), sum_ans;
+		for (size_t i = 0; i < num; i++)
+			accounts[i] = {{a[i], (int64_t)i}};
+		for (auto [k, v] : sums)
+			sum_ans.push_back({{k, v}});
+		write_binary_file(in_path, accounts);
+		auto sum_eq = [](auto&& x, auto&& y) {
+			return x.value.key == y.value.key && x.value.amount == y.value.amount;
+		};
+		for (size_t s : {1 << 10, 1 << 12}) {
+			test_mode(external_multiway_merge_sorter<account_record, reduce_by<add_amount>>(s),
+					  in_path, sum_ans, sum_eq);
+			test_mode(external_twoway_merge_sorter<account_record, reduce_by<add_amount>>(s),
+					  in_path, sum_ans, sum_eq);
+		}
+	}
+
+	// Unique values and counts of a small domain.
+	auto b = generate<int16_t>(1000000, -1000, 1000);
+	std::map<int16_t, uint64_t> counts;
+	for (auto x : b)
+		counts[x]++;
+	std::vector<int16_t> uniq;
+	std::vector<counted_record<int16_t>> counted_ans;
+	for (auto [k, c] : counts) {
+		uniq.push_back(k);
+		counted_ans.push_back({{k, c}});
+	}
+	auto in_path = data_path / "mode_domain.in";
+	write_binary_file(in_path, b);
+	for (size_t s : {1 << 10, 1 << 16}) {
+		test_mode(external_counting_sorter<int16_t, keep_unique>(s), in_path, uniq,
+				  std::equal_to<>());
+		test_mode(external_counting_sorter<int16_t, count_keys>(s), in_path, counted_ans,
+				  [](auto&& x, auto&& y) {
+					  return x.value.value == y.value.value && x.value.count == y.value.count;
+				  });
+	}
+	return 0;
+}
@@ -29,6 +29,8 @@ struct judge_impl {
 			J.test_sort(external_twoway_merge_sorter<T>(s, s << 2));
 			J.test_sort(external_twoway_merge_sorter<T>(s, s << 3));
 			J.test_sort(external_twoway_merge_sorter<T>(s, s << 4));
+			J.test_sort(external_twoway_merge_sorter<T>(s, s, 4));	  // Concurrent merges
+			J.test_sort(external_twoway_merge_sorter<T>(s, s, 4, 2)); // Concurrent binary merges
 			J.dump_result(result_path);
 		}
 	}
@@ -11,7 +11,7 @@ using namespace qy;
 
 struct judge_impl {
 	judge J;
-	std::vector<size_t> buffer_sizes{ /*1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14,1 << 15,*/ 1 << 16, 1 << 17, 1 << 18, 1 << 19, 1 << 20 };
+	std::vector<size_t> buffer_sizes{ 1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, 1 << 15, 1 << 16, 1 << 17, 1 << 18, 1 << 19, 1 << 20 };
 	fs::path result_path;
 
 	judge_impl() : result_path(fmt::format("test/out/result_{:%Y%m%d%H%M%S}.csv", fmt::localtime(std::time(nullptr)))) {
@@ -0,0 +1,80 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "sort/external_record_sort.hpp"
+#include "sort/external_twoway_merge_sort.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <nameof.hpp>
+#include <random>
+
+using namespace qy;
+
+struct record {
+	int32_t key;
+	uint32_t id;
+	char payload[120];
+};
+
+template <class R>
+void generate_records(size_t num, int32_t rmax, int seed, const fs::path& in_path,
+					  const fs::path& ans_path) {
+	std::vector<R> a(num);
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<int32_t> distrib(0, rmax);
+	for (uint32_t i = 0; i < num; i++) {
+		a[i].key = distrib(rng);
+		a[i].id = i;
+		std::ranges::fill(a[i].payload, static_cast<char>(i));
+	}
+	std::ofstream fin(in_path, std::ios_base::binary | std::ios_base::trunc);
+	fin.write(reinterpret_cast<const char*>(a.data()), a.size() * sizeof(R));
+	// Stable order is the only valid answer, since ids are distinct.
+	std::ranges::stable_sort(a, {}, &R::key);
+	std::ofstream fans(ans_path, std::ios_base::binary | std::ios_base::trunc);
+	fans.write(reinterpret_cast<const char*>(a.data()), a.size() * sizeof(R));
+}
+
+template <class Sorter>
+void test_record_sort(Sorter&& sorter, const fs::path& in_path, const fs::path& ans_path,
+					  bool stable) {
+	fmt::print(fmt::fg(fmt::color::yellow), "Test {}\n", nameof::nameof_type<Sorter>());
+	fs::path out_path = in_path;
+	out_path.replace_extension(".out");
+	auto t = func_timer(sorter, in_path, out_path);
+	auto out = read_binary_file<record>(out_path);
+	auto ans = read_binary_file<record>(ans_path);
+	bool ok = out.size() == ans.size() &&
+			  std::ranges::equal(out, ans, {}, &record::key, &record::key);
+	if (stable)
+		ok = ok && file_compare(out_path, ans_path);
+	// Payload must follow its key.
+	ok = ok && std::ranges::all_of(out, [](const record& r) {
+		return std::ranges::all_of(r.payload, [&](char c) { return c == static_cast<char>(r.id); });
+	});
+	fmt::print(fmt::fg(ok ? fmt::color::lime_green : fmt::color::red), "  {} {}ms\n",
+			   ok ? "AC" : "WA", t.count() / 1000000);
+}
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	for (auto [num, rmax] : {std::pair{100000uz, 1 << 30}, std::pair{100000uz, 100}}) {
+		auto in_path = data_path / fmt::format("record_{}_{}.in", num, rmax);
+		auto ans_path = data_path / fmt::format("record_{}_{}.ans", num, rmax);
+		generate_records<record>(num, rmax, 0, in_path, ans_path);
+		for (size_t s : {1 << 10, 1 << 12}) {
+			test_record_sort(external_record_sorter<record, &record::key>(s, false), in_path,
+							 ans_path, false);
+			test_record_sort(external_record_sorter<record, &record::key>(s, true), in_path,
+							 ans_path, true);
+			test_record_sort(external_record_sorter<record, &record::key, std::less<>,
+													external_twoway_merge_sorter>(s, true),
+							 in_path, ans_path, true);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,61 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/external_select.hpp"
+#include "sort/partial_sort.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+
+using namespace qy;
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	for (auto [num, rmax] : {std::pair{1000000uz, 1 << 30}, std::pair{1000000uz, 100}}) {
+		auto a = generate<int32_t>(num, 0, rmax);
+		auto in_path = data_path / fmt::format("select_{}_{}.in", num, rmax);
+		auto out_path = data_path / fmt::format("select_{}_{}.out", num, rmax);
+		write_binary_file(in_path, a);
+		auto sorted = a;
+		std::ranges::sort(sorted);
+
+		for (size_t s : {1 << 10, 1 << 14}) {
+			// Top-K by the heap and by the quick sorter.
+			for (size_t k : {100uz, 100000uz}) {
+				for (bool largest : {false, true}) {
+					partial_sorter<int32_t> sorter(s, k, largest);
+					auto t = func_timer(sorter, in_path, out_path);
+					auto out = read_binary_file<int32_t>(out_path);
+					auto ans = largest ? std::span(sorted).last(k) : std::span(sorted).first(k);
+					print_result(fmt::format("partial_sorter({}, {}, {})", s, k, largest),
+								 std::ranges::equal(out, ans), t);
+				}
+			}
+			// Quantiles and ranks at both ends.
+			std::vector<double> ps{0.999, 0.5, 0.99, 0.0, 1.0};
+			std::vector<int32_t> ans;
+			for (double p : ps)
+				ans.push_back(sorted[(size_t)std::floor(p * (num - 1))]);
+			external_selector<int32_t> selector(s);
+			std::vector<int32_t> values;
+			auto t = func_timer([&]() { values = selector.quantiles(in_path, ps, out_path); });
+			print_result(fmt::format("external_selector({})", s), values == ans, t);
+			// A rank past the end is rejected before any pass.
+			bool thrown = false;
+			std::vector<size_t> ranks{0, num};
+			t = func_timer([&]() {
+				try {
+					selector(in_path, ranks, out_path);
+				} catch (const std::out_of_range&) {
+					thrown = true;
+				}
+			});
+			print_result(fmt::format("external_selector({}) out of range", s), thrown, t);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+// #pragma GCC optimize(3)
+// #define DEBUG
+#define LOGGING
+#include "fixtures.hpp"
+#include "sort/external_counting_sort.hpp"
+#include "sort/external_multiway_merge_sort.hpp"
+#include "sort/external_radix_sort.hpp"
+#include "sort/external_twoway_merge_sort.hpp"
+#include "utils/futils.hpp"
+#include "utils/timer.hpp"
+#include <fmt/color.h>
+#include <fmt/core.h>
+#include <nameof.hpp>
+#include <sstream>
+
+using namespace qy;
+
+/// @brief Sort from a stream holding the bytes of values, which has no path nor known length.
+template <class T, class Sorter>
+void test_stream(Sorter&& sorter, const std::vector<T>& a, const fs::path& out_path) {
+	std::stringstream input(std::string(reinterpret_cast<const char*>(a.data()), a.size() * sizeof(T)),
+							std::ios_base::in | std::ios_base::binary);
+	auto t = func_timer([&]() { sorter(input, out_path); });
+	auto out = read_binary_file<T>(out_path);
+	auto ans = a;
+	std::ranges::sort(ans);
+	bool ok = std::ranges::equal(out, ans, [](auto&& x, auto&& y) { return !(x < y) && !(y < x); });
+	print_result(nameof::nameof_type<Sorter>(), ok, t);
+}
+
+/// @brief Sort and iterate the last merge as a stream, without writing the output.
+template <class T, class Mode>
+void test_merge_stream(size_t buffer_size, const std::vector<T>& a, const fs::path& in_path) {
+	write_binary_file(in_path, a);
+	std::vector<T> out;
+	auto work_path = in_path;
+	work_path.replace_extension(".work");
+	auto t = func_timer([&]() {
+		external_multiway_merge_sorter<T, Mode> sorter(buffer_size);
+		for (auto&& x : sorter.stream(in_path, work_path))
+			out.push_back(x);
+	});
+	auto ans = a;
+	std::ranges::sort(ans);
+	if constexpr (collapses<Mode>) {
+		auto [last, _] = std::ranges::unique(ans);
+		ans.erase(last, ans.end());
+	}
+	bool ok = out == ans && !fs::exists(work_path.replace_filename(".merge")) &&
+			  !fs::exists(work_path.replace_filename(".merge_pass"));
+	print_result(fmt::format("stream of {}",
+							 nameof::nameof_type<external_multiway_merge_sorter<T, Mode>>()),
+				 ok, t);
+}
+
+int main() {
+	auto data_path = fs::current_path() / "test" / "data";
+	if (!fs::exists(data_path))
+		fs::create_directories(data_path);
+	auto out_path = data_path / "stream.out";
+	for (size_t num : {0uz, 1000uz, 1000000uz}) {
+		auto a = generate<int32_t>(num, 0, 1 << 30);
+		auto b = generate<int16_t>(num, INT16_MIN, INT16_MAX);
+		auto c = generate<account_record>(num, 0, 1 << 30);
+		for (size_t s : {1 << 10, 1 << 14}) {
+			test_stream(external_multiway_merge_sorter<int32_t>(s), a, out_path);
+			test_stream(external_twoway_merge_sorter<int32_t>(s), a, out_path);
+			test_stream(external_multiway_merge_sorter<account_record>(s), c, out_path);
+			test_stream(external_counting_sorter<int16_t>(s), b, out_path);
+			test_stream(external_radix_sorter<int32_t>(s), a, out_path);
+			test_merge_stream<int32_t, keep_all>(s, a, data_path / "stream.in");
+			test_merge_stream<int16_t, keep_unique>(s, b, data_path / "stream.in");
+			// A presorted input is a single run, read by one stream of the pool.
+			auto sorted = a;
+			std::ranges::sort(sorted);
+			test_merge_stream<int32_t, keep_all>(s, sorted, data_path / "stream.in");
+		}
+	}
+	return 0;
+}
@@ -53,16 +53,23 @@ target("proj3-test_sort")
 target("proj4-test_loser")
     add_files("src/proj4/test_loser_tree.cpp")
 
+target("proj4-bench_loser")
+    add_files("src/proj4/bench_loser_tree.cpp")
+
 target("proj4-test_sort")
     add_files("src/proj4/test_sort.cpp")
 
 target("proj5-test_sort")
     add_files("src/proj5/test_sort.cpp")
 
+target("proj5-bench_sort")
+    add_files("src/proj5/bench_sort.cpp")
+    add_packages("fmt", "nameof", "nlohmann_json")
+
 target("test-gen_data")
     add_files("test/gen_data.cpp")
 
-add_test_target("sort_proj2", "sort_proj3", "sort_proj4", "sort_proj5", "sort_all")
+add_test_target("sort_proj2", "sort_proj3", "sort_proj4", "sort_proj5", "sort_all", "sort_record", "sort_mode", "sort_select", "sort_levels", "sort_stream", "sort_join", "sort_auto", "sort_fan_in")
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io